@@ -0,0 +1,584 @@
+// blockcache.cc
+//	Routines to manage the write-back cache of disk sectors.
+//
+//	Every sector lives in at most one frame; a hash table maps
+//	sector numbers to the frame holding them.  On a miss we run the
+//	clock hand around the frames until we find one that is either
+//	empty or has not been referenced since the last pass, write it
+//	back if it is dirty, and re-use it.
+//
+//	Sectors that are contiguous on disk are transferred together
+//	whenever possible: a run of misses is read with one disk request,
+//	and writing back a dirty frame also writes back every dirty frame
+//	holding the sectors right before and after it.
+//
+//	No disk request is made with the cache locked, except to write a
+//	run too big for the cache straight through.  Evicting a dirty
+//	frame means unlocking the cache to write it back, after which the
+//	sector being brought in may already be there, so Replace gives up
+//	and its caller looks the sector up again.
+//
+//	Read-ahead is done by a thread of its own, which takes runs of
+//	sectors off "prefetchQueue" and reads them into frames marked
+//	"prefetched".  A read that finds such a frame counts as a prefetch
+//	hit; a prefetched frame evicted without ever being read counts as
+//	wasted.  Prefetched frames start out referenced, so that the clock
+//	does not evict them ahead of frames the reader is already done with.
+//
+//	A write of a sector that is not in the cache does not need to
+//	read the sector first, since the disk only ever transfers whole
+//	sectors -- the caller is overwriting all of it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "debug.h"
+#include "main.h"
+#include "blockcache.h"
+#include "journal.h"
+
+//----------------------------------------------------------------------
+// FrameKey, SectorHash
+//	Functions needed by the hash table indexing the cache frames.
+//----------------------------------------------------------------------
+
+static int
+FrameKey(CacheFrame *frame)
+{
+    return frame->sector;
+}
+
+static unsigned
+SectorHash(int sector)
+{
+    return (unsigned) sector;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::BlockCache
+// 	Initialize an empty block cache.
+//
+//	"disk" -- the synchronous disk to go to on a miss
+//	"numFrames" -- the number of sectors the cache can hold
+//----------------------------------------------------------------------
+
+BlockCache::BlockCache(SynchDisk *disk, int numFrames)
+{
+    synchDisk = disk;
+    journal = NULL;
+    this->numFrames = numFrames;
+    frames = new CacheFrame[numFrames];
+    for (int i = 0; i < numFrames; i++) {
+	frames[i].sector = -1;
+	frames[i].valid = FALSE;
+	frames[i].dirty = FALSE;
+	frames[i].referenced = FALSE;
+	frames[i].busy = FALSE;
+	frames[i].prefetched = FALSE;
+	frames[i].data = new char[SectorSize];
+    }
+    index = new HashTable<int, CacheFrame *>(FrameKey, SectorHash);
+    clockHand = 0;
+    lock = new Lock("block cache lock");
+    frameReady = new Condition("block cache frame ready");
+    prefetchQueue = new SynchList<PrefetchRequest *>;
+    prefetchSectors = new char *[numFrames];
+
+    Thread *t = new Thread("read ahead", 1);
+    t->Fork(BlockCache::ReadAheadThread, this);
+}
+
+//----------------------------------------------------------------------
+// BlockCache::~BlockCache
+// 	De-allocate the block cache.  Any dirty sectors are written
+//	back first.
+//----------------------------------------------------------------------
+
+BlockCache::~BlockCache()
+{
+    Flush();
+    for (int i = 0; i < numFrames; i++) {
+	if (frames[i].prefetched)
+	    kernel->stats->numPrefetchWasted++;
+	if (frames[i].valid)
+	    index->Remove(frames[i].sector);
+	delete [] frames[i].data;
+    }
+    delete index;
+    delete [] frames;
+    delete frameReady;
+    delete lock;
+    delete prefetchQueue;
+    delete [] prefetchSectors;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::ReadSector
+// 	Read the contents of a disk sector into a buffer, from the cache
+//	if possible.
+//
+//	"sectorNumber" -- the disk sector to read
+//	"data" -- the buffer to hold the contents of the disk sector
+//----------------------------------------------------------------------
+
+void
+BlockCache::ReadSector(int sectorNumber, char* data)
+{
+    ReadSectors(sectorNumber, 1, data);
+}
+
+//----------------------------------------------------------------------
+// BlockCache::WriteSector
+// 	Write the contents of a buffer into the cached copy of a disk
+//	sector.  The disk itself is updated later, on eviction or Flush.
+//
+//	"sectorNumber" -- the disk sector to be written
+//	"data" -- the new contents of the disk sector
+//----------------------------------------------------------------------
+
+void
+BlockCache::WriteSector(int sectorNumber, char* data)
+{
+    WriteSectors(sectorNumber, 1, data);
+}
+
+//----------------------------------------------------------------------
+// BlockCache::ReadSectors
+// 	Read the contents of a run of consecutive disk sectors into a
+//	buffer.  Sectors found in the cache are copied from memory; each
+//	run of consecutive misses is read from disk with a single request,
+//	straight into the caller's buffer, and then copied into the cache.
+//
+//	The frames for the run are marked busy, and the cache unlocked, 
+//	while the disk does its work.  The run is no longer than the 
+//	number of frames that are not busy, so that we never have to wait
+//	for a frame while holding busy ones of our own.  If making room
+//	for the run means writing back a dirty frame, the run is cut 
+//	short there.
+//
+//	"sectorNumber" -- the first disk sector to read
+//	"numSectors" -- the number of sectors to read
+//	"data" -- the buffer to hold the contents of the disk sectors
+//----------------------------------------------------------------------
+
+void
+BlockCache::ReadSectors(int sectorNumber, int numSectors, char* data)
+{
+    CacheFrame *frame;
+    int i, j, count, idle;
+    bool found;
+
+    lock->Acquire();
+    for (i = 0; i < numSectors; i += count) {
+	frame = Lookup(sectorNumber + i);
+	if (frame != NULL) {
+	    if (frame->prefetched) {
+		kernel->stats->numPrefetchHits++;
+		frame->prefetched = FALSE;
+	    }
+	    frame->referenced = TRUE;
+	    bcopy(frame->data, &data[i * SectorSize], SectorSize);
+	    count = 1;
+	    continue;
+	}
+	idle = IdleFrames();
+	for (count = 1; i + count < numSectors && count < idle; count++) 
+	    if (index->Find(sectorNumber + i + count, &frame))
+		break;
+	kernel->stats->numCacheMisses += count - 1;
+	for (j = i; j < i + count; j++) {
+	    frame = Replace(sectorNumber + j);
+	    if (frame == NULL)		// the cache was unlocked, stop here
+		break;
+	    frame->busy = TRUE;
+	}
+	count = j - i;
+	if (count == 0)			// look for the sector again
+	    continue;
+
+	lock->Release();
+	synchDisk->ReadSectors(sectorNumber + i, count, &data[i * SectorSize]);
+	lock->Acquire();
+
+	for (j = i; j < i + count; j++) {
+	    found = index->Find(sectorNumber + j, &frame);
+	    ASSERT(found && frame->busy);
+	    frame->busy = FALSE;
+	    frame->referenced = TRUE;
+	    if (journal != NULL)	// logged, but not home yet?
+		journal->Find(sectorNumber + j, &data[j * SectorSize]);
+	    bcopy(&data[j * SectorSize], frame->data, SectorSize);
+	}
+	frameReady->Broadcast(lock);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BlockCache::WriteSectors
+// 	Write the contents of a buffer into the cached copies of a run of
+//	consecutive disk sectors.  As with WriteSector, the disk is only
+//	updated later; the run is written back together when its frames
+//	are evicted or flushed.
+//
+//	A run at least as long as the cache would only push everything
+//	else out, and then be evicted itself a frame at a time, so it is
+//	written straight to the disk instead, as one request per track.
+//	Any of its sectors that are cached are updated, and left clean.
+//
+//	A sector that must be logged (cf. Journal::IsLogging) goes to
+//	the journal instead, and its frame is left clean until the journal
+//	commits it.  If the frame was dirty, its old contents are handed
+//	to the journal, rather than written to disk now.
+//
+//	"sectorNumber" -- the first disk sector to be written
+//	"numSectors" -- the number of sectors to write
+//	"data" -- the new contents of the disk sectors
+//----------------------------------------------------------------------
+
+void
+BlockCache::WriteSectors(int sectorNumber, int numSectors, char* data)
+{
+    CacheFrame *frame;
+    bool logging = FALSE;
+
+    lock->Acquire();
+    for (int i = 0; journal != NULL && i < numSectors; i++)
+	if (journal->IsLogging(sectorNumber + i))
+	    logging = TRUE;
+    if (logging) {
+	for (int i = 0; i < numSectors; i++) {
+	    if ((frame = Lookup(sectorNumber + i)) == NULL
+			&& (frame = Replace(sectorNumber + i)) == NULL) {
+		i--;			// the cache was unlocked; look for
+		continue;		// the sector again
+	    }
+	    journal->Log(sectorNumber + i, &data[i * SectorSize], 
+			frame->dirty ? frame->data : NULL);
+	    frame->referenced = TRUE;
+	    frame->dirty = FALSE;
+	    frame->prefetched = FALSE;
+	    bcopy(&data[i * SectorSize], frame->data, SectorSize);
+	}
+	lock->Release();
+	return;
+    }
+    if (numSectors >= numFrames) {
+	for (int i = 0; i < numSectors; i++)	// let any reads of the run
+	    if (index->Find(sectorNumber + i, &frame) && frame->busy) {
+		frameReady->Wait(lock);		// finish first, so they
+		i = -1;				// don't overwrite our data
+	    }
+	for (int i = 0; i < numSectors; i++) {
+	    if (!index->Find(sectorNumber + i, &frame))
+		continue;
+	    frame->dirty = FALSE;
+	    frame->prefetched = FALSE;
+	    bcopy(&data[i * SectorSize], frame->data, SectorSize);
+	}
+	DEBUG(dbgFile, "Writing " << numSectors << " sectors through from sector " << sectorNumber);
+	synchDisk->WriteSectors(sectorNumber, numSectors, data);
+	lock->Release();
+	return;
+    }
+    for (int i = 0; i < numSectors; i++) {
+	if ((frame = Lookup(sectorNumber + i)) == NULL
+		&& (frame = Replace(sectorNumber + i)) == NULL) {
+	    i--;			// the cache was unlocked; look for
+	    continue;			// the sector again
+	}
+	frame->referenced = TRUE;
+	frame->dirty = TRUE;
+	frame->prefetched = FALSE;
+	bcopy(&data[i * SectorSize], frame->data, SectorSize);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Prefetch
+// 	Ask the read-ahead thread to bring a run of consecutive sectors
+//	into the cache.  Returns immediately; sectors already in the 
+//	cache by the time the request is handled are skipped.  If every
+//	sector is in the cache already, or on its way, there is nothing
+//	for the read-ahead thread to do.
+//
+//	"sectorNumber" -- the first disk sector to read ahead
+//	"numSectors" -- the number of sectors to read ahead
+//----------------------------------------------------------------------
+
+void
+BlockCache::Prefetch(int sectorNumber, int numSectors)
+{
+    CacheFrame *frame;
+    bool missing = FALSE;
+
+    ASSERT((sectorNumber >= 0) && (sectorNumber + numSectors <= NumSectors));
+    lock->Acquire();
+    for (int i = 0; i < numSectors && !missing; i++)
+	missing = !index->Find(sectorNumber + i, &frame);
+    lock->Release();
+    if (!missing)
+	return;
+    DEBUG(dbgFile, "Read ahead " << numSectors << " sectors from sector " << sectorNumber);
+    prefetchQueue->Append(new PrefetchRequest(sectorNumber, numSectors));
+    kernel->currentThread->Yield();	// let the read-ahead thread get
+					// the disk going before we go on
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Flush
+// 	Write every dirty frame back to the disk, and make sure the
+//	disk has them in its UNIX file.  The frames stay valid, so later
+//	reads are still satisfied from memory.  Transfers other threads
+//	have under way are waited for, so that they are in the file too.
+//----------------------------------------------------------------------
+
+void
+BlockCache::Flush()
+{
+    lock->Acquire();
+    for (int i = 0; i < numFrames; i++)
+	if (frames[i].valid && frames[i].dirty)
+	    WriteBack(&frames[i]);
+    while (IdleFrames() < numFrames)
+	frameReady->Wait(lock);
+    synchDisk->Flush();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Lookup
+// 	Return the frame holding "sectorNumber", or NULL if the sector
+//	is not in the cache.  Updates the hit/miss statistics.
+//
+//	If the sector is still being read in by another thread, wait for
+//	it.  On a miss, first wait until some frame is not busy, so that
+//	the caller can always Replace one.
+//----------------------------------------------------------------------
+
+CacheFrame *
+BlockCache::Lookup(int sectorNumber)
+{
+    CacheFrame *frame;
+
+    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    for (;;) {
+	if (index->Find(sectorNumber, &frame)) {
+	    if (!frame->busy) {
+		kernel->stats->numCacheHits++;
+		return frame;
+	    }
+	} else if (IdleFrames() > 0) {
+	    kernel->stats->numCacheMisses++;
+	    return NULL;
+	}
+	frameReady->Wait(lock);
+    }
+}
+
+//----------------------------------------------------------------------
+// BlockCache::IdleFrames
+// 	Return the number of frames that are not busy being read in or
+//	written back, and so could be replaced.
+//----------------------------------------------------------------------
+
+int
+BlockCache::IdleFrames()
+{
+    int count = 0;
+
+    for (int i = 0; i < numFrames; i++)
+	if (!frames[i].busy)
+	    count++;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Replace
+// 	Pick a frame to hold "sectorNumber", using the CLOCK algorithm:
+//	sweep the frames, giving each referenced frame a second chance,
+//	until we find an empty or unreferenced one.  Busy frames are 
+//	skipped; the caller makes sure there is at least one that is not.
+//
+//	If the victim is dirty, write it back, and return NULL: the cache
+//	was unlocked meanwhile, so someone else may have brought the
+//	sector in, or taken the frame.  The caller must look the sector
+//	up again.  Otherwise the returned frame is valid and clean, but
+//	its data is garbage; the caller must fill it in.
+//----------------------------------------------------------------------
+
+CacheFrame *
+BlockCache::Replace(int sectorNumber)
+{
+    CacheFrame *frame;
+
+    for (;;) {
+	frame = &frames[clockHand];
+	clockHand = (clockHand + 1) % numFrames;
+	if (frame->busy)
+	    continue;
+	if (!frame->valid)
+	    break;
+	if (!frame->referenced)
+	    break;
+	frame->referenced = FALSE;	// second chance
+    }
+
+    if (frame->valid) {
+	if (frame->dirty) {
+	    WriteBack(frame);
+	    return NULL;
+	}
+	DEBUG(dbgFile, "Evicting sector " << frame->sector << " from block cache");
+	if (frame->prefetched)
+	    kernel->stats->numPrefetchWasted++;
+	index->Remove(frame->sector);
+	kernel->stats->numCacheEvictions++;
+    }
+    frame->sector = sectorNumber;
+    frame->valid = TRUE;
+    frame->dirty = FALSE;
+    frame->referenced = FALSE;
+    frame->prefetched = FALSE;
+    index->Insert(frame);
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::WriteBack
+// 	Write a dirty frame back to disk, together with the dirty frames
+//	holding the sectors immediately before and after it, as a single
+//	run.  All of the frames written are marked clean.
+//
+//	The frames are written straight from the cache, gathered into
+//	one request.  They are marked busy, so that no one changes or
+//	evicts them, and the cache unlocked, while the disk does its work.
+//	Busy frames are never dirty, so the run does not take in frames
+//	someone else is reading in or writing back.
+//----------------------------------------------------------------------
+
+void
+BlockCache::WriteBack(CacheFrame *frame)
+{
+    CacheFrame *neighbour;
+    int first = frame->sector;
+    int count, i;
+    char **sectors;
+    bool found;
+
+    ASSERT(frame->valid && frame->dirty && !frame->busy);
+    while (first > 0 && index->Find(first - 1, &neighbour) 
+		&& neighbour->dirty)
+	first--;
+    for (count = 0; first + count < NumSectors; count++)
+	if (!index->Find(first + count, &neighbour) || !neighbour->dirty)
+	    break;
+    sectors = new char *[count];
+    for (i = 0; i < count; i++) {
+	index->Find(first + i, &neighbour);
+	sectors[i] = neighbour->data;
+	neighbour->dirty = FALSE;
+	neighbour->busy = TRUE;
+    }
+    DEBUG(dbgFile, "Writing back " << count << " sectors from sector " << first);
+
+    lock->Release();
+    synchDisk->WriteSectors(first, count, sectors);
+    lock->Acquire();
+
+    for (i = 0; i < count; i++) {
+	found = index->Find(first + i, &neighbour);
+	ASSERT(found && neighbour->busy);
+	neighbour->busy = FALSE;
+    }
+    frameReady->Broadcast(lock);
+    delete [] sectors;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::ReadAheadThread
+// 	The read-ahead thread: forever wait for a prefetch request, and
+//	carry it out.
+//
+//	"cache" -- the block cache to read ahead into
+//----------------------------------------------------------------------
+
+void
+BlockCache::ReadAheadThread(void *cache)
+{
+    BlockCache *blockCache = (BlockCache *) cache;
+
+    for (;;)
+	blockCache->ReadAhead(blockCache->prefetchQueue->RemoveFront());
+}
+
+//----------------------------------------------------------------------
+// BlockCache::ReadAhead
+// 	Read the sectors of a prefetch request that are not already in the
+//	cache.  Like a miss in ReadSectors, each run of missing sectors is
+//	read with one disk request, into busy frames, with the cache 
+//	unlocked.  
+//
+//	Read-ahead never takes more than half of the frames that are not
+//	busy or already holding unused read-ahead, leaving the rest for 
+//	demand reads, and keeping read-ahead from evicting itself.
+//----------------------------------------------------------------------
+
+void
+BlockCache::ReadAhead(PrefetchRequest *request)
+{
+    CacheFrame *frame;
+    int sector = request->sectorNumber;
+    int end = request->sectorNumber + request->numSectors;
+    int j, count, limit;
+    bool found;
+
+    lock->Acquire();
+    for (; sector < end; sector += count) {
+	count = 1;
+	if (index->Find(sector, &frame))	// cached, or on its way
+	    continue;
+	limit = 0;			// frames neither busy nor
+	for (j = 0; j < numFrames; j++)	// holding unused read-ahead
+	    if (!frames[j].busy && !frames[j].prefetched)
+		limit++;
+	limit /= 2;
+	if (limit == 0)
+	    break;
+	for (; sector + count < end && count < limit; count++)
+	    if (index->Find(sector + count, &frame))
+		break;
+	for (j = sector; j < sector + count; j++) {
+	    frame = Replace(j);
+	    if (frame == NULL)		// the cache was unlocked, stop here
+		break;
+	    frame->busy = TRUE;
+	    frame->prefetched = TRUE;
+	    prefetchSectors[j - sector] = frame->data;
+	}
+	count = j - sector;
+	if (count == 0)			// look at the sector again
+	    continue;
+	kernel->stats->numPrefetched += count;
+
+	lock->Release();		// busy frames are left alone, so 
+					// the disk can fill them in directly
+	synchDisk->ReadSectors(sector, count, prefetchSectors);
+	lock->Acquire();
+
+	for (j = sector; j < sector + count; j++) {
+	    found = index->Find(j, &frame);
+	    ASSERT(found && frame->busy);
+	    frame->busy = FALSE;
+	    frame->referenced = TRUE;
+	    if (journal != NULL)
+		journal->Find(j, frame->data);
+	}
+	frameReady->Broadcast(lock);
+    }
+    lock->Release();
+    delete request;
+}
@@ -0,0 +1,151 @@
+// blockcache.h
+//	Data structures for a write-back cache of disk sectors.
+//
+//	The block cache sits between the file system and the synchronous
+//	disk.  All file headers, directories, the free sector bitmap and
+//	file data are read and written through it, so that repeated
+//	accesses to the same sector are satisfied from memory instead
+//	of paying for a simulated seek and rotation every time.
+//
+//	The cache holds a fixed number of sector-sized frames.  Frames
+//	are replaced using the CLOCK (second chance) algorithm.  Writes
+//	only mark the frame dirty; the data reaches the disk when the
+//	frame is evicted, or when the cache is explicitly flushed.
+//	Whenever a dirty frame goes to disk, any dirty neighbours in
+//	the cache go with it, as a single multi-sector request.
+//
+//	The cache lock is released while a miss is being read in, or
+//	dirty frames are being written back, so that other threads can
+//	use the cache, and queue their own disk requests, in the meantime.
+//	Frames on their way to or from the disk are marked busy; anyone
+//	who wants one waits until the transfer completes.
+//
+//	While a file system operation is in progress, sectors written go
+//	to the journal (cf. journal.h) as well as the cache, and are left
+//	clean, so that they do not reach the disk until the journal has
+//	committed them.  Until then, a miss on one of them is satisfied
+//	from the journal's copy.
+//
+//	Sectors can also be read ahead, in the background, by a separate
+//	read-ahead thread, so that a thread reading a file sequentially
+//	finds the next sectors already in memory.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include "hash.h"
+#include "synch.h"
+#include "synchdisk.h"
+#include "synchlist.h"
+
+class Journal;
+
+const int NumCacheFrames = 64;		// number of sectors kept in memory
+
+// The following class defines a request to read a run of consecutive
+// sectors into the cache ahead of time.
+
+class PrefetchRequest {
+  public:
+    PrefetchRequest(int sector, int count) 
+		{ sectorNumber = sector; numSectors = count; }
+
+    int sectorNumber;			// First sector to read ahead
+    int numSectors;			// Number of sectors in the run
+};
+
+// The following class defines a single frame of the block cache,
+// holding the contents of one disk sector.
+//
+// Internal data structures kept public so that BlockCache operations
+// can access them directly.
+
+class CacheFrame {
+  public:
+    int sector;				// Disk sector cached in this frame
+    bool valid;				// Does this frame hold a sector?
+    bool dirty;				// Modified since read from disk?
+    bool referenced;			// Used since the clock hand last
+					//  passed by?
+    bool busy;				// Being read in from disk, or
+					//  written back to it?  Either
+					//  way, hands off
+    bool prefetched;			// Read ahead, and not yet used?
+    char *data;				// Contents of the sector
+};
+
+// The following class defines the block cache.  Its interface
+// mirrors that of SynchDisk, so that it can be used anywhere the
+// file system would otherwise go to the disk directly.
+
+class BlockCache {
+  public:
+    BlockCache(SynchDisk *disk, int numFrames);
+					// Initialize an empty cache of
+					// "numFrames" sectors on top of "disk"
+    ~BlockCache();			// Flush and de-allocate the cache
+
+    void ReadSector(int sectorNumber, char* data);
+    					// Read/write a disk sector, going
+					// to the disk only on a cache miss
+    void WriteSector(int sectorNumber, char* data);
+
+    void ReadSectors(int sectorNumber, int numSectors, char* data);
+					// Read/write a run of consecutive
+					// sectors; runs of misses go to the
+					// disk as a single request
+    void WriteSectors(int sectorNumber, int numSectors, char* data);
+
+    void Prefetch(int sectorNumber, int numSectors);
+					// Start reading a run of sectors 
+					// into the cache; return at once
+
+    void Flush();			// Write every dirty frame back to
+					// disk
+
+    void SetJournal(Journal *journal) { this->journal = journal; }
+					// Log sectors written during file
+					// system operations to "journal"
+
+  private:
+    SynchDisk *synchDisk;		// Where misses and evictions go
+    Journal *journal;			// Where operations are logged, or
+					// NULL
+    int numFrames;			// Number of frames in the cache
+    CacheFrame *frames;			// The frames themselves
+    HashTable<int, CacheFrame *> *index;
+					// Sector number -> frame holding it
+    int clockHand;			// Next frame considered for eviction
+    Lock *lock;				// Only one thread may touch the
+					// cache at a time
+    Condition *frameReady;		// Signalled when a busy frame has
+					// been read in or written back
+    SynchList<PrefetchRequest *> *prefetchQueue;
+					// Runs waiting to be read ahead
+    char **prefetchSectors;		// The frames a run is being read
+					// ahead into
+
+    CacheFrame *Lookup(int sectorNumber);
+					// Frame holding the sector, or NULL
+    int IdleFrames();			// Number of frames not busy
+    CacheFrame *Replace(int sectorNumber);
+					// Evict a frame and re-use it for
+					// the sector; NULL if a dirty frame
+					// had to be written back first
+    void WriteBack(CacheFrame *frame);	// Write a dirty frame, and its
+					// dirty neighbours, to disk, with
+					// the cache unlocked
+
+    static void ReadAheadThread(void *cache);
+					// Body of the read-ahead thread
+    void ReadAhead(PrefetchRequest *request);
+					// Read a run of sectors ahead
+};
+
+#endif // BLOCKCACHE_H
@@ -0,0 +1,163 @@
+// dcache.cc
+//	Routines to remember the results of directory lookups, so that
+//	resolving a path name does not read every directory along the
+//	way in from disk.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "debug.h"
+#include "dcache.h"
+
+//----------------------------------------------------------------------
+// DentryKeyOf, DentryHash
+//	Functions needed by the hash table indexing the cached lookups.
+//----------------------------------------------------------------------
+
+static DentryKey
+DentryKeyOf(Dentry *dentry)
+{
+    return dentry->key;
+}
+
+static unsigned
+DentryHash(DentryKey key)
+{
+    unsigned hash = 5381;
+
+    for (int i = 0; i < FileNameMaxLen && key.name[i] != '\0'; i++)
+	hash = hash * 33 + (unsigned char) key.name[i];
+    return hash ^ (unsigned) key.parent;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::DentryCache
+// 	Initialize an empty dentry cache.
+//
+//	"size" -- the number of lookups the cache can remember
+//----------------------------------------------------------------------
+
+DentryCache::DentryCache(int size)
+{
+    this->size = size;
+    index = new HashTable<DentryKey, Dentry *>(DentryKeyOf, DentryHash);
+    entries = new List<Dentry *>;
+    hits = misses = 0;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::~DentryCache
+// 	De-allocate the dentry cache, and every entry in it.
+//----------------------------------------------------------------------
+
+DentryCache::~DentryCache()
+{
+    Dentry *dentry;
+
+    DEBUG(dbgFile, "Dentry cache: hits " << hits << ", misses " << misses);
+    while (!entries->IsEmpty()) {
+	dentry = entries->RemoveFront();
+	index->Remove(dentry->key);
+	delete dentry;
+    }
+    delete entries;
+    delete index;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Lookup
+// 	Look for the result of looking up "name" in a directory.  Return
+//	FALSE if it is not cached.  Otherwise return TRUE, and set
+//	"sector" to the sector of the file's header, or -1 if the name
+//	is known not to be in the directory.
+//
+//	"parent" -- sector of the directory's header
+//	"name" -- the name to look up
+//	"sector", "isDir" -- set to the result of the lookup
+//----------------------------------------------------------------------
+
+bool
+DentryCache::Lookup(int parent, char *name, int *sector, bool *isDir)
+{
+    DentryKey key;
+    Dentry *dentry;
+
+    key.parent = parent;
+    strncpy(key.name, name, FileNameMaxLen);
+    key.name[FileNameMaxLen] = '\0';
+    if (!index->Find(key, &dentry)) {
+	misses++;
+	return FALSE;
+    }
+    hits++;
+    *sector = dentry->sector;
+    *isDir = dentry->isDir;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Enter
+// 	Remember the result of looking up "name" in a directory,
+//	replacing anything already cached for it.  If the cache is
+//	full, the oldest entry is forgotten to make room.
+//
+//	"parent" -- sector of the directory's header
+//	"name" -- the name looked up
+//	"sector" -- sector of the file's header, or -1 if not found
+//	"isDir" -- is the file a directory?
+//----------------------------------------------------------------------
+
+void
+DentryCache::Enter(int parent, char *name, int sector, bool isDir)
+{
+    Dentry *dentry = new Dentry;
+    Dentry *old;
+
+    dentry->key.parent = parent;
+    strncpy(dentry->key.name, name, FileNameMaxLen);
+    dentry->key.name[FileNameMaxLen] = '\0';
+    dentry->sector = sector;
+    dentry->isDir = isDir;
+    DEBUG(dbgFile, "Dentry <" << parent << ", " << dentry->key.name
+		<< "> -> " << sector);
+
+    if (index->Find(dentry->key, &old)) {
+	index->Remove(old->key);
+	entries->Remove(old);
+	delete old;
+    } else if ((int) entries->NumInList() == size) {
+	old = entries->RemoveFront();
+	index->Remove(old->key);
+	delete old;
+    }
+    index->Insert(dentry);
+    entries->Append(dentry);
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Purge
+// 	Forget every lookup made in a directory that has been deleted;
+//	its header sector may be re-used for a different file.
+//
+//	"parent" -- sector of the deleted directory's header
+//----------------------------------------------------------------------
+
+void
+DentryCache::Purge(int parent)
+{
+    List<Dentry *> *keep = new List<Dentry *>;
+    Dentry *dentry;
+
+    while (!entries->IsEmpty()) {
+	dentry = entries->RemoveFront();
+	if (dentry->key.parent == parent) {
+	    index->Remove(dentry->key);
+	    delete dentry;
+	} else
+	    keep->Append(dentry);
+    }
+    delete entries;
+    entries = keep;
+}
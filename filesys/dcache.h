@@ -0,0 +1,87 @@
+// dcache.h
+//	Data structures for a cache of directory lookups.
+//
+//	Resolving a path name such as "/t0/bb/f3" means looking up each
+//	component in turn, in the directory named by the components
+//	before it.  Without help, every lookup would read the directory
+//	in from disk again, even though the same few directories near
+//	the root are searched over and over.
+//
+//	The dentry cache remembers the result of recent lookups: for
+//	the pair <directory header sector, component name>, the sector
+//	of the file's header, and whether the file is itself a
+//	directory.  It also remembers names that were looked for and not
+//	found ("negative" entries), so that a failed lookup, such as the
+//	one Create makes before adding a name, is not repeated either.
+//
+//	The cache holds a fixed number of entries; when it is full, the
+//	oldest entry is dropped.  It is up to the file system to keep
+//	the cache consistent with the directories on disk, by entering
+//	every name it adds or removes.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include "hash.h"
+#include "list.h"
+#include "directory.h"
+
+const int NumDentries = 64;		// number of lookups remembered
+
+// The following class defines the key of a cached lookup: a name,
+// in the directory whose header is in sector "parent".
+
+class DentryKey {
+  public:
+    int parent;				// Sector of the directory's header
+    char name[FileNameMaxLen + 1];	// Name looked up in the directory
+
+    bool operator==(const DentryKey &other) const
+	{ return parent == other.parent &&
+		!strncmp(name, other.name, FileNameMaxLen); }
+};
+
+// The following class defines a single cached lookup.  "sector" is -1
+// for a negative entry, a name known not to be in the directory.
+
+class Dentry {
+  public:
+    DentryKey key;			// What was looked up
+    int sector;				// Where the file header is, or -1
+    bool isDir;				// Is the file a directory?
+};
+
+// The following class defines the dentry cache.
+
+class DentryCache {
+  public:
+    DentryCache(int size);		// Initialize an empty cache of
+					// "size" entries
+    ~DentryCache();			// De-allocate the cache
+
+    bool Lookup(int parent, char *name, int *sector, bool *isDir);
+					// Return TRUE if the lookup of "name"
+					// in "parent" is cached, and if so
+					// the result
+    void Enter(int parent, char *name, int sector, bool isDir);
+					// Remember the result of a lookup;
+					// "sector" is -1 if not found
+    void Purge(int parent);		// Forget every lookup in the
+					// directory "parent", which has
+					// been deleted
+
+  private:
+    int size;				// Most entries the cache may hold
+    HashTable<DentryKey, Dentry *> *index;
+					// <parent, name> -> cached lookup
+    List<Dentry *> *entries;		// The entries, oldest first
+    int hits, misses;			// How useful the cache has been
+};
+
+#endif // DCACHE_H
@@ -11,9 +11,14 @@
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
+//	The directory is not limited in size.  The entries are stored 
+//	in sector-sized chunks; when every entry is in use, Add makes
+//	room for another chunk, and Remove drops empty chunks off the end.
+//
+//	Names are looked up through an in-memory hash index: each bucket
+//	heads a chain of the entries whose names hash to it, linked through
+//	"next".  Unused entries are chained through "next" as well, on a 
+//	free list.  Neither is part of the on-disk format.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -21,7 +26,10 @@
 
 #include "copyright.h"
 #include "utility.h"
+#include "debug.h"
+#include "main.h"
 #include "filehdr.h"
+#include "inode.h"
 #include "directory.h"
 
 //----------------------------------------------------------------------
@@ -31,19 +39,21 @@
 //	is all we need, but otherwise, we need to call FetchFrom in order
 //	to initialize it from disk.
 //
-//	"size" is the number of entries in the directory
+//	"size" is the number of entries to make room for; it is rounded
+//	up to a whole number of chunks, and at least one
 //----------------------------------------------------------------------
 
 Directory::Directory(int size)
 {
-    table = new DirectoryEntry[size];
-	
-	// MP4 mod tag
-	memset(table, 0, sizeof(DirectoryEntry) * size);  // dummy operation to keep valgrind happy
-	
-    tableSize = size;
-    for (int i = 0; i < tableSize; i++)
-	    table[i].inUse = FALSE;
+    table = NULL;
+    next = NULL;
+    chunkDirty = NULL;
+    bucket = NULL;
+    tableSize = numChunks = maxChunks = numBuckets = 0;
+    freeList = -1;
+    do {
+	AddChunk();
+    } while (tableSize < size);
 }
 
 //----------------------------------------------------------------------
@@ -52,13 +62,92 @@ Directory::Directory(int size)
 //----------------------------------------------------------------------
 
 Directory::~Directory()
-{ 
+{
     delete [] table;
-} 
+    delete [] next;
+    delete [] chunkDirty;
+    delete [] bucket;
+}
+
+//----------------------------------------------------------------------
+// Directory::Reserve
+// 	Make sure the in-core arrays have room for "chunks" chunks, and
+//	the hash index has at least one bucket per entry.  The arrays
+//	grow by doubling, so that adding chunks one at a time takes
+//	constant time on average.
+//
+//	Rebuilds the hash index and free list if the index is resized.
+//----------------------------------------------------------------------
+
+void
+Directory::Reserve(int chunks)
+{
+    DirectoryEntry *newTable;
+    int *newNext;
+    bool *newDirty;
+    int entries;
+
+    if (chunks > maxChunks) {
+	maxChunks = max(chunks, 2 * maxChunks);
+	entries = maxChunks * NumChunkEntries;
+	newTable = new DirectoryEntry[entries];
+	// MP4 mod tag
+	memset(newTable, 0, sizeof(DirectoryEntry) * entries);  // dummy operation to keep valgrind happy
+	newNext = new int[entries];
+	newDirty = new bool[maxChunks];
+	for (int i = 0; i < tableSize; i++) {
+	    newTable[i] = table[i];
+	    newNext[i] = next[i];
+	}
+	for (int c = 0; c < numChunks; c++)
+	    newDirty[c] = chunkDirty[c];
+	delete [] table;
+	delete [] next;
+	delete [] chunkDirty;
+	table = newTable;
+	next = newNext;
+	chunkDirty = newDirty;
+    }
+
+    if (chunks * NumChunkEntries > numBuckets) {
+	if (numBuckets == 0)
+	    numBuckets = 1;
+	while (numBuckets < chunks * NumChunkEntries)
+	    numBuckets *= 2;		// at most one entry per bucket,
+					// on average
+	delete [] bucket;
+	bucket = new int[numBuckets];
+	BuildIndex();
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::AddChunk
+// 	Add a chunk of unused entries to the end of the directory, and
+//	put them on the free list.  The chunk is marked dirty, so that
+//	WriteBack will write it out.
+//----------------------------------------------------------------------
+
+void
+Directory::AddChunk()
+{
+    int first = tableSize;
+
+    Reserve(numChunks + 1);
+    for (int i = first + NumChunkEntries - 1; i >= first; i--) {
+	table[i].inUse = FALSE;
+	next[i] = freeList;
+	freeList = i;
+    }
+    chunkDirty[numChunks] = TRUE;
+    numChunks++;
+    tableSize += NumChunkEntries;
+}
 
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Read the contents of the directory from disk.  The directory
+//	takes on the size of the file.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
@@ -66,12 +155,28 @@ Directory::~Directory()
 void
 Directory::FetchFrom(OpenFile *file)
 {
-    (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    int chunks = file->Length() / SectorSize;
+    char *buf = new char[chunks * SectorSize];
+
+    (void) file->ReadAt(buf, chunks * SectorSize, 0);
+    Reserve(chunks);
+    numChunks = chunks;
+    tableSize = chunks * NumChunkEntries;
+    for (int c = 0; c < numChunks; c++) {
+	bcopy(&buf[c * SectorSize], (char *) &table[c * NumChunkEntries],
+		NumChunkEntries * sizeof(DirectoryEntry));
+	chunkDirty[c] = FALSE;
+    }
+    delete [] buf;
+    BuildIndex();
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk.  Only
+//	the chunks that changed are written; a run of consecutive changed
+//	chunks is written in one go.  The file must already be at least
+//	FileSize() bytes long.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
@@ -79,7 +184,85 @@ Directory::FetchFrom(OpenFile *file)
 void
 Directory::WriteBack(OpenFile *file)
 {
-    (void) file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    char *buf;
+    int first, c;
+
+    ASSERT(file->Length() >= FileSize());
+    for (first = 0; first < numChunks; first = c) {
+	if (!chunkDirty[first]) {
+	    c = first + 1;
+	    continue;
+	}
+	for (c = first; c < numChunks && chunkDirty[c]; c++)
+	    ;
+	buf = new char[(c - first) * SectorSize];
+	memset(buf, 0, (c - first) * SectorSize);
+	for (int i = first; i < c; i++) {
+	    bcopy((char *) &table[i * NumChunkEntries],
+		&buf[(i - first) * SectorSize],
+		NumChunkEntries * sizeof(DirectoryEntry));
+	    chunkDirty[i] = FALSE;
+	}
+	(void) file->WriteAt(buf, (c - first) * SectorSize, first * SectorSize);
+	delete [] buf;
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::FileSize
+// 	Return the number of bytes the directory file must hold, to store
+//	every chunk of the directory.
+//----------------------------------------------------------------------
+
+int
+Directory::FileSize()
+{
+    return numChunks * SectorSize;
+}
+
+//----------------------------------------------------------------------
+// Directory::BuildIndex
+// 	Rebuild the hash index and the free list from scratch, from the
+//	contents of the table.  The free list is kept in table order, so
+//	that new names fill the directory from the front, as before.
+//----------------------------------------------------------------------
+
+void
+Directory::BuildIndex()
+{
+    int i, b;
+
+    for (b = 0; b < numBuckets; b++)
+	bucket[b] = -1;
+    freeList = -1;
+    for (i = tableSize - 1; i >= 0; i--) {
+	if (table[i].inUse) {
+	    b = Bucket(table[i].name);
+	    next[i] = bucket[b];
+	    bucket[b] = i;
+	} else {
+	    next[i] = freeList;
+	    freeList = i;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::Bucket
+// 	Hash a file name (only the part of it that is stored in a
+//	directory entry) to a bucket of the index.
+//
+//	"name" -- the file name to hash
+//----------------------------------------------------------------------
+
+int
+Directory::Bucket(char *name)
+{
+    unsigned hash = 5381;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+	hash = hash * 33 + (unsigned char) name[i];
+    return hash & (numBuckets - 1);
 }
 
 //----------------------------------------------------------------------
@@ -93,8 +276,8 @@ Directory::WriteBack(OpenFile *file)
 int
 Directory::FindIndex(char *name)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
+    for (int i = bucket[Bucket(name)]; i != -1; i = next[i])
+        if (!strncmp(table[i].name, name, FileNameMaxLen))
 	    return i;
     return -1;		// name not in directory
 }
@@ -118,31 +301,55 @@ Directory::Find(char *name)
     return -1;
 }
 
+//----------------------------------------------------------------------
+// Directory::IsDirectory
+// 	Return TRUE if "name" is in the directory, and is itself a 
+//	directory.
+//
+//	"name" -- the file name to look up
+//----------------------------------------------------------------------
+
+bool
+Directory::IsDirectory(char *name)
+{
+    int i = FindIndex(name);
+
+    return i != -1 && table[i].isDir;
+}
+
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
-//	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	return FALSE if the file name is already in the directory.
+//	If every entry is in use, the directory grows by a chunk.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
+//	"isDir" -- is the added file itself a directory?
 //----------------------------------------------------------------------
 
 bool
-Directory::Add(char *name, int newSector)
+Directory::Add(char *name, int newSector, bool isDir)
 { 
+    int i, b;
+
     if (FindIndex(name) != -1)
 	return FALSE;
+    if (freeList == -1)
+	AddChunk();
 
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse) {
-            table[i].inUse = TRUE;
-            strncpy(table[i].name, name, FileNameMaxLen); 
-            table[i].sector = newSector;
-        return TRUE;
-	}
-    return FALSE;	// no space.  Fix when we have extensible files.
+    i = freeList;
+    freeList = next[i];
+    table[i].inUse = TRUE;
+    strncpy(table[i].name, name, FileNameMaxLen); 
+    table[i].sector = newSector;
+    table[i].isDir = isDir;
+    chunkDirty[i / NumChunkEntries] = TRUE;
+
+    b = Bucket(table[i].name);
+    next[i] = bucket[b];
+    bucket[b] = i;
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -150,31 +357,148 @@ Directory::Add(char *name, int newSector)
 // 	Remove a file name from the directory.  Return TRUE if successful;
 //	return FALSE if the file isn't in the directory. 
 //
+//	Once the last two chunks are both empty, the last one is dropped;
+//	keeping one empty chunk spare means that adding and removing a
+//	file over and over in a full directory does not resize it each 
+//	time.
+//
 //	"name" -- the file name to be removed
 //----------------------------------------------------------------------
 
 bool
 Directory::Remove(char *name)
 { 
-    int i = FindIndex(name);
+    int b = Bucket(name);
+    int i, prev = -1;
 
+    for (i = bucket[b]; i != -1; prev = i, i = next[i])
+        if (!strncmp(table[i].name, name, FileNameMaxLen))
+	    break;
     if (i == -1)
 	    return FALSE; 		// name not in directory
-    table[i].inUse = FALSE;
+
+    if (prev == -1)			// unlink from the bucket...
+	bucket[b] = next[i];
+    else
+	next[prev] = next[i];
+    table[i].inUse = FALSE;		// ...and put on the free list
+    next[i] = freeList;
+    freeList = i;
+    chunkDirty[i / NumChunkEntries] = TRUE;
+
+    if (numChunks > 1 && ChunkEmpty(numChunks - 1) 
+		&& ChunkEmpty(numChunks - 2)) {
+	do {
+	    numChunks--;
+	    tableSize -= NumChunkEntries;
+	} while (numChunks > 1 && ChunkEmpty(numChunks - 1) 
+		&& ChunkEmpty(numChunks - 2));
+	BuildIndex();			// drop the entries from the free list
+    }
     return TRUE;	
 }
 
+//----------------------------------------------------------------------
+// Directory::ChunkEmpty
+// 	Return TRUE if no entry in chunk "c" is in use.
+//----------------------------------------------------------------------
+
+bool
+Directory::ChunkEmpty(int c)
+{
+    for (int i = c * NumChunkEntries; i < (c + 1) * NumChunkEntries; i++)
+	if (table[i].inUse)
+	    return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::IsEmpty
+// 	Return TRUE if no entry in the directory is in use.
+//----------------------------------------------------------------------
+
+bool
+Directory::IsEmpty()
+{
+    for (int c = 0; c < numChunks; c++)
+	if (!ChunkEmpty(c))
+	    return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::FirstEntry
+// 	Return the sector number of the first file in the directory, or
+//	-1 if the directory is empty.  Used to take a directory apart
+//	one file at a time.
+//
+//	"name" -- set to the name of the file; must have room for 
+//		FileNameMaxLen + 1 characters
+//	"isDir" -- set to whether the file is a directory
+//----------------------------------------------------------------------
+
+int
+Directory::FirstEntry(char *name, bool *isDir)
+{
+    for (int i = 0; i < tableSize; i++)
+	if (table[i].inUse) {
+	    strncpy(name, table[i].name, FileNameMaxLen);
+	    name[FileNameMaxLen] = '\0';
+	    *isDir = table[i].isDir;
+	    return table[i].sector;
+	}
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Directory::NextEntry
+// 	Return the sector number of the first file in the directory at
+//	or after "position", and advance "position" past it, so that
+//	calling NextEntry again, starting with "position" 0, visits every
+//	file.  Return -1 if there are no more.
+//
+//	"position" -- where in the directory to start looking
+//	"isDir" -- set to whether the file is a directory
+//----------------------------------------------------------------------
+
+int
+Directory::NextEntry(int *position, bool *isDir)
+{
+    for (; *position < tableSize; (*position)++)
+	if (table[*position].inUse) {
+	    *isDir = table[*position].isDir;
+	    return table[(*position)++].sector;
+	}
+    return -1;
+}
+
 //----------------------------------------------------------------------
 // Directory::List
-// 	List all the file names in the directory. 
+// 	List all the file names in the directory, marking directories
+//	with [D] and other files with [F]. 
+//
+//	"recursive" -- also list the contents of each sub-directory,
+//		indented under its name
+//	"depth" -- how deep this directory is in the listing
 //----------------------------------------------------------------------
 
 void
-Directory::List()
+Directory::List(bool recursive, int depth)
 {
-   for (int i = 0; i < tableSize; i++)
-	if (table[i].inUse)
-	    printf("%s\n", table[i].name);
+    for (int i = 0; i < tableSize; i++)
+	if (table[i].inUse) {
+	    printf("%*s[%c] %.*s\n", 4 * depth, "", 
+		table[i].isDir ? 'D' : 'F', FileNameMaxLen, table[i].name);
+	    if (recursive && table[i].isDir) {
+		OpenFile *file = new OpenFile(table[i].sector);
+		Directory *sub = new Directory(NumChunkEntries);
+
+		sub->FetchFrom(file);
+		sub->List(TRUE, depth + 1);
+		delete sub;
+		delete file;
+	    }
+	}
 }
 
 //----------------------------------------------------------------------
@@ -186,15 +510,16 @@ Directory::List()
 void
 Directory::Print()
 { 
-    FileHeader *hdr = new FileHeader;
+    Inode *inode;
 
     printf("Directory contents:\n");
     for (int i = 0; i < tableSize; i++)
 	if (table[i].inUse) {
-	    printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
-	    hdr->FetchFrom(table[i].sector);
-	    hdr->Print();
+	    printf("Name: %.*s, Sector: %d%s\n", FileNameMaxLen, table[i].name, 
+		table[i].sector, table[i].isDir ? ", Directory" : "");
+	    inode = kernel->inodeTable->Acquire(table[i].sector);
+	    inode->hdr->Print();
+	    kernel->inodeTable->Release(inode);
 	}
     printf("\n");
-    delete hdr;
 }
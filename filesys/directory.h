@@ -24,7 +24,8 @@
 
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
-// the file's header is to be found on disk.
+// the file's header is to be found on disk.  The file may itself be
+// a directory, which is how the directory tree is built.
 //
 // Internal data structures kept public so that Directory operations can
 // access them directly.
@@ -32,12 +33,20 @@
 class DirectoryEntry {
   public:
     bool inUse;				// Is this directory entry in use?
+    bool isDir;				// Is the file itself a directory?
     int sector;				// Location on disk to find the 
 					//   FileHeader for this file 
     char name[FileNameMaxLen + 1];	// Text name for file, with +1 for 
 					// the trailing '\0'
 };
 
+// On disk, directory entries are grouped in "chunks", one per sector,
+// so that no entry straddles two sectors, and a directory grows or
+// shrinks a sector at a time.  Any space left at the end of a chunk
+// is unused.
+
+#define NumChunkEntries	((int) (SectorSize / sizeof(DirectoryEntry)))
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
@@ -46,12 +55,24 @@ class DirectoryEntry {
 //
 // The constructor initializes a directory structure in memory; the
 // FetchFrom/WriteBack operations shuffle the directory information
-// from/to disk. 
+// from/to disk.  WriteBack only writes the chunks that have changed.
+//
+// The directory has no fixed size: when every entry is in use, Add 
+// makes room for another chunk of entries, and Remove drops empty
+// chunks from the end.  FileSize says how big the directory file must
+// be to hold the current chunks; it is up to the caller to grow or
+// shrink the file to match before calling WriteBack.
+//
+// In memory, the entries are also indexed by a hash table on the file
+// name, and the unused entries are kept on a free list, so that finding,
+// adding and removing a name does not scan the whole table.  The index 
+// is never stored on disk; it is rebuilt whenever the table is fetched.
 
 class Directory {
   public:
     Directory(int size); 		// Initialize an empty directory
-					// with space for "size" files
+					// with space for at least "size" 
+					// files
     ~Directory();			// De-allocate the directory
 
     void FetchFrom(OpenFile *file);  	// Init directory contents from disk
@@ -61,12 +82,27 @@ class Directory {
     int Find(char *name);		// Find the sector number of the 
 					// FileHeader for file: "name"
 
-    bool Add(char *name, int newSector);  // Add a file name into the directory
+    bool IsDirectory(char *name);	// Is "name" a sub-directory?
+
+    bool Add(char *name, int newSector, bool isDir = FALSE);
+					// Add a file name into the directory
 
     bool Remove(char *name);		// Remove a file from the directory
 
-    void List();			// Print the names of all the files
-					//  in the directory
+    int FileSize();			// Bytes needed to store the directory
+
+    bool IsEmpty();			// Is no file in the directory?
+    int FirstEntry(char *name, bool *isDir);
+					// Sector, name and kind of some file
+					// in the directory, -1 if empty
+    int NextEntry(int *position, bool *isDir);
+					// Sector and kind of the file at or
+					// after "position", -1 if none
+
+    void List(bool recursive, int depth);
+					// Print the names of all the files
+					//  in the directory, and optionally
+					//  of all its sub-directories
     void Print();			// Verbose print of the contents
 					//  of the directory -- all the file
 					//  names and their contents.
@@ -83,7 +119,27 @@ class Directory {
     int tableSize;			// Number of directory entries
     DirectoryEntry *table;		// Table of pairs: 
 					// <file name, file header location> 
-
+    int numChunks;			// Number of chunks; tableSize is
+					// numChunks * NumChunkEntries
+    int maxChunks;			// Number of chunks there is room for
+					// in the in-core arrays
+    bool *chunkDirty;			// Which chunks WriteBack must write
+
+    int numBuckets;			// Size of the hash index
+    int *bucket;			// For each hash value, the first entry
+					// in use with a name hashing to it
+    int *next;				// For an entry in use, the next one 
+					// in the same bucket; for an unused 
+					// one, the next on the free list
+    int freeList;			// First unused entry, -1 if full
+
+    void AddChunk();			// Make room for more entries
+    void Reserve(int chunks);		// Make the in-core arrays big enough
+					// for "chunks" chunks
+    void BuildIndex();			// Rebuild the hash index and free 
+					// list from the table
+    int Bucket(char *name);		// Which bucket "name" hashes to
+    bool ChunkEmpty(int c);		// Is no entry in chunk "c" in use?
     int FindIndex(char *name);		// Find the index into the directory 
 					//  table corresponding to "name"
 };
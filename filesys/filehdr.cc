@@ -3,12 +3,22 @@
 //	would be called the i-node).
 //
 //	The file header is used to locate where on disk the 
-//	file's data is stored.  We implement this as a fixed size
-//	table of pointers -- each entry in the table points to the 
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect 
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector, 
+//	file's data is stored.  We implement this as a list of extents
+//	-- each extent is a run of consecutive disk sectors holding
+//	consecutive blocks of the file.  The first few extents are
+//	stored in the header sector itself; any more are stored in a
+//	chain of overflow sectors.
+//
+//	When space is allocated, we ask the bitmap for a run of free
+//	sectors as long as the whole file; if there isn't one, we keep
+//	halving the length asked for, so that a file is split into as
+//	few pieces as the free space allows.  A file small enough to fit
+//	in the header sector, in place of the extents, is given no data
+//	sectors at all.
+//
+//	A file may also have holes: runs of blocks that have never been
+//	written, described by an extent of HoleSector, and given sectors
+//	only when they are first written.
 //
 //      Unlike in a real system, we do not keep track of file permissions, 
 //	ownership, last modification date, etc., in the file header. 
@@ -26,7 +36,7 @@
 
 #include "filehdr.h"
 #include "debug.h"
-#include "synchdisk.h"
+#include "blockcache.h"
 #include "main.h"
 
 //----------------------------------------------------------------------
@@ -40,52 +50,518 @@ FileHeader::FileHeader()
 {
 	numBytes = -1;
 	numSectors = -1;
-	memset(dataSectors, -1, sizeof(dataSectors));
+	numExtents = 0;
+	chainSector = -1;
+	extentTable = NULL;
+	maxExtents = 0;
+	extentOffset = NULL;
+	chainTable = NULL;
+	numChainSectors = 0;
+	lastExtent = 0;
+	headerData = NULL;
+	numHoleSectors = 0;
 }
 
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileHeader::~FileHeader
-//	Currently, there is not need to do anything in destructor function.
-//	However, if you decide to add some "in-core" data in header
-//	Always remember to deallocate their space or you will leak memory
+//	De-allocate the in-core extent tables.
 //----------------------------------------------------------------------
 FileHeader::~FileHeader()
 {
-	// nothing to do now
+	FreeTables();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FreeTables
+//	De-allocate the in-core tables, so that the header can be
+//	re-initialized by Allocate or FetchFrom.
+//----------------------------------------------------------------------
+
+void
+FileHeader::FreeTables()
+{
+    delete [] extentTable;
+    delete [] extentOffset;
+    delete [] chainTable;
+    delete [] headerData;
+    extentTable = NULL;
+    maxExtents = 0;
+    extentOffset = NULL;
+    chainTable = NULL;
+    numChainSectors = 0;
+    lastExtent = 0;
+    headerData = NULL;
+    numHoleSectors = 0;
+}
+
+//----------------------------------------------------------------------
+// ChainSectorsNeeded
+//	Return how many overflow extent sectors are needed to hold
+//	"count" extents.
+//----------------------------------------------------------------------
+
+static int
+ChainSectorsNeeded(int count)
+{
+    if (count <= NumInlineExtents)
+	return 0;
+    return divRoundUp(count - NumInlineExtents, NumChainExtents);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AddExtent
+//	Append a run of sectors to the end of the file's in-core extent
+//	table, growing the table if needed.  If the run directly follows
+//	the last extent on disk, or both are holes, just make that extent
+//	longer.
+//
+//	"start" is the first disk sector of the run, or HoleSector
+//	"length" is the number of sectors in the run
+//----------------------------------------------------------------------
+
+void
+FileHeader::AddExtent(int start, int length)
+{
+    Extent *last = (numExtents > 0) ? &extentTable[numExtents - 1] : NULL;
+
+    if (last != NULL && ((last->start == HoleSector) ? start == HoleSector
+		: last->start + last->length == start)) {
+	last->length += length;
+	return;
+    }
+    if (numExtents == maxExtents) {
+	Extent *bigger;
+
+	maxExtents = (maxExtents == 0) ? NumInlineExtents : maxExtents * 2;
+	bigger = new Extent[maxExtents];
+	for (int i = 0; i < numExtents; i++)
+	    bigger[i] = extentTable[i];
+	delete [] extentTable;
+	extentTable = bigger;
+    }
+    extentTable[numExtents].start = start;
+    extentTable[numExtents].length = length;
+    numExtents++;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::BuildOffsets
+//	Compute the file sector at which each extent begins, so that
+//	ByteToSector can binary search the extent table, and count the
+//	sectors in holes.
+//----------------------------------------------------------------------
+
+void
+FileHeader::BuildOffsets()
+{
+    int offset = 0;
+
+    delete [] extentOffset;
+    extentOffset = new int[numExtents];
+    numHoleSectors = 0;
+    for (int i = 0; i < numExtents; i++) {
+	extentOffset[i] = offset;
+	offset += extentTable[i].length;
+	if (extentTable[i].start == HoleSector)
+	    numHoleSectors += extentTable[i].length;
+    }
+    ASSERT(offset == numSectors);
+    lastExtent = 0;
 }
 
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
-//	Allocate data blocks for the file out of the map of free disk blocks.
+//	Allocate data blocks for the file out of the map of free disk blocks,
+//	in runs that are as long as possible.
 //	Return FALSE if there are not enough free blocks to accomodate
 //	the new file.
 //
+//	A "sparse" file is given no data blocks: they are all in a hole,
+//	until they are written.  The bitmap and the directories are
+//	written through the file system itself, so they are never sparse.
+//
 //	"freeMap" is the bit map of free disk sectors
-//	"fileSize" is the bit map of free disk sectors
+//	"fileSize" is the number of bytes in the new file
+//	"sparse" is whether to leave the data blocks unallocated
 //----------------------------------------------------------------------
 
 bool
-FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
+FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize, bool sparse)
 { 
-    numBytes = fileSize;
-    numSectors  = divRoundUp(fileSize, SectorSize);
-    if (freeMap->NumClear() < numSectors)
+    FreeTables();
+    numBytes = 0;
+    numSectors = 0;
+    numExtents = 0;
+    if (sparse && fileSize > MaxHeaderData) {
+	numSectors = divRoundUp(fileSize, SectorSize);
+	numBytes = fileSize;
+	AddExtent(HoleSector, numSectors);
+	BuildOffsets();
+	DEBUG(dbgFile, "Allocated a hole of " << numSectors << " sectors");
+	return TRUE;
+    }
+    BuildOffsets();
+    if (!Extend(freeMap, fileSize))
+	return FALSE;
+    DEBUG(dbgFile, "Allocated " << numSectors << " sectors in " << numExtents << " extents");
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Extend
+// 	Make the file "newSize" bytes long, allocating whatever data 
+//	blocks that takes.  We first try to take the free sectors right 
+//	after the end of the file, so that its last extent just gets 
+//	longer; the rest is allocated in runs as long as possible, as 
+//	in Allocate.  More overflow extent sectors are allocated if the
+//	new extents do not fit in the ones the file already has.
+//
+//	A file with no data sectors that is to be no more than
+//	MaxHeaderData bytes long gets none: its data is kept in the
+//	header.  If it is to be longer, the data kept so far is moved
+//	out to the first of its new sectors.
+//
+//	A file growing a little at a time can ask for "reserve" more
+//	sectors than it needs, allocated along with the rest if there is
+//	room, so that it can grow into them later without coming back
+//	to the free map, and they stay next to the rest of the file.  If
+//	the file already has sectors enough, reserved earlier, only its
+//	length changes, and "freeMap" is not used.  If the reserve leaves
+//	too few free sectors for the overflow extent sectors, the file is
+//	extended without it.
+//
+//	A "sparse" extension allocates no data blocks: the new ones are
+//	left in a hole, as in a sparse file, and any sectors reserved
+//	past the old end are given back, so that they do not show up in
+//	the middle of the file holding whatever was on disk.  Data kept
+//	in the header still needs a sector of its own.
+//
+//	Return FALSE, leaving the file as it was, if there is not
+//	enough free space.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newSize" is the new length of the file, in bytes
+//	"reserve" is the number of sectors to allocate past the new end
+//	"sparse" is whether to leave the new data blocks unallocated
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Extend(PersistentBitmap *freeMap, int newSize, int reserve,
+			bool sparse)
+{
+    int oldSize = numBytes;
+    int oldSectors = numSectors;
+    int remaining = divRoundUp(newSize, SectorSize) - numSectors;
+    int runLength, start;
+
+    ASSERT(newSize >= numBytes);
+    if (sparse && newSize > MaxHeaderData)
+	return ExtendSparse(freeMap, newSize);
+    if (numSectors == 0 && newSize <= MaxHeaderData) {	// fits in header
+	if (headerData == NULL) {
+	    headerData = new char[MaxHeaderData];
+	    memset(headerData, 0, MaxHeaderData);
+	}
+	numBytes = newSize;
+	return TRUE;
+    }
+    if (remaining <= 0) {	// fits in sectors reserved earlier
+	numBytes = newSize;
+	return TRUE;
+    }
+    if (freeMap->NumFree() < remaining)
 	return FALSE;		// not enough space
+    if (freeMap->NumFree() >= remaining + reserve)
+	remaining += reserve;
+
+    if (numExtents > 0 && extentTable[numExtents - 1].start != HoleSector) {
+				// grow the last extent in place
+	start = extentTable[numExtents - 1].start 
+			+ extentTable[numExtents - 1].length;
+	for (runLength = 0; runLength < remaining 
+		&& start + runLength < NumSectors
+		&& !freeMap->Test(start + runLength); runLength++)
+	    freeMap->Mark(start + runLength);
+	if (runLength > 0) {
+	    AddExtent(start, runLength);
+	    numSectors += runLength;
+	    remaining -= runLength;
+	}
+    }
+
+    AllocateRuns(freeMap, remaining);
+    numSectors += remaining;
+    numBytes = newSize;
+    BuildOffsets();
+
+    if (!GrowChain(freeMap)) {		// no room to describe the file
+	Truncate(freeMap, (oldSectors == 0) ? 0 : oldSize);
+	numBytes = oldSize;
+	return reserve > 0 && Extend(freeMap, newSize);	// without reserve
+    }
+    if (headerData != NULL)
+	MoveHeaderData();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::MaxSectorsToExtend
+// 	Return the most free sectors that Extend could need to make the
+//	file "newSize" bytes long, without reserving any: its new data
+//	blocks, and an overflow extent sector for every NumChainExtents
+//	of them, in case each is allocated in a run of its own.
+//
+//	"newSize" is the new length of the file, in bytes
+//----------------------------------------------------------------------
+
+int
+FileHeader::MaxSectorsToExtend(int newSize)
+{
+    int needed = divRoundUp(newSize, SectorSize) - numSectors;
+
+    if ((numSectors == 0 && newSize <= MaxHeaderData) || needed <= 0)
+	return 0;
+    return needed + divRoundUp(needed, NumChainExtents);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ExtendSparse
+// 	Make the file "newSize" bytes long, leaving the data blocks past
+//	its sectors in a hole.  Called by Extend, which describes the
+//	arguments and the result.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::ExtendSparse(PersistentBitmap *freeMap, int newSize)
+{
+    int oldSize = numBytes;
+    int holes;
+
+    if (numBytes > 0 && numSectors == 0) {	// data kept in the header
+	if (!Extend(freeMap, min(newSize, SectorSize)))
+	    return FALSE;
+	oldSize = numBytes;
+    } else if (headerData != NULL) {	// room for data, but none yet
+	delete [] headerData;
+	headerData = NULL;
+    }
+    Truncate(freeMap, numBytes);	// give back the reserved sectors
+    holes = divRoundUp(newSize, SectorSize) - numSectors;
+    if (holes > 0) {
+	AddExtent(HoleSector, holes);
+	numSectors += holes;
+    }
+    numBytes = newSize;
+    BuildOffsets();
+
+    if (!GrowChain(freeMap)) {		// no room to describe the file
+	Truncate(freeMap, oldSize);
+	return FALSE;
+    }
+    DEBUG(dbgFile, "Extended by a hole of " << holes << " sectors");
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::MoveHeaderData
+// 	A file whose data was kept in the header has just been given data
+//	sectors.  Write the data out to the first of them, where it now
+//	belongs, and forget it.
+//----------------------------------------------------------------------
+
+void
+FileHeader::MoveHeaderData()
+{
+    char *data = new char[SectorSize];
+
+    DEBUG(dbgFile, "Moving header data out to sector " << extentTable[0].start);
+    memset(data, 0, SectorSize);
+    bcopy(headerData, data, MaxHeaderData);
+    kernel->blockCache->WriteSector(extentTable[0].start, data);
+    delete [] data;
+    delete [] headerData;
+    headerData = NULL;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateRuns
+// 	Allocate "count" sectors, in runs as long as the free space
+//	allows, and append them to the in-core extent table.  The caller
+//	has checked that there are that many sectors free, and rebuilds
+//	the offsets.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"count" is the number of sectors to allocate
+//----------------------------------------------------------------------
+
+void
+FileHeader::AllocateRuns(PersistentBitmap *freeMap, int count)
+{
+    int runLength = count;
+    int start;
+
+    while (count > 0) {
+	runLength = min(runLength, count);
+	start = freeMap->FindAndSetRun(runLength);
+	if (start == -1) {
+	    // no run that long; since we checked that there was enough
+	    // free space, a run of one sector must succeed
+	    ASSERT(runLength > 1);
+	    runLength /= 2;
+	    continue;
+	}
+	AddExtent(start, runLength);
+	count -= runLength;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::GrowChain
+// 	Allocate more overflow extent sectors, if the extents no longer
+//	fit in the ones the file has.  Return FALSE, allocating none, if
+//	there are not enough free sectors.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
 
-    for (int i = 0; i < numSectors; i++) {
-		dataSectors[i] = freeMap->FindAndSet();
-		// since we checked that there was enough free space,
-		// we expect this to succeed
-		ASSERT(dataSectors[i] >= 0);
+bool
+FileHeader::GrowChain(PersistentBitmap *freeMap)
+{
+    int needed = ChainSectorsNeeded(numExtents);
+    int *biggerChain;
+    int i;
+
+    if (needed <= numChainSectors)
+	return TRUE;
+    if (freeMap->NumFree() < needed - numChainSectors)
+	return FALSE;
+    biggerChain = new int[needed];
+    for (i = 0; i < numChainSectors; i++)
+	biggerChain[i] = chainTable[i];
+    for (; i < needed; i++) {
+	biggerChain[i] = freeMap->FindAndSet();
+	ASSERT(biggerChain[i] >= 0);
     }
+    delete [] chainTable;
+    chainTable = biggerChain;
+    numChainSectors = needed;
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::FillHoles
+// 	Allocate sectors for every block of the file from byte "from" up
+//	to byte "to" that is in a hole, so that it can be written.  Each
+//	hole is split around the blocks filled in; the new sectors are
+//	allocated in runs as long as possible, as in Extend.  The caller
+//	must make sure the contents of the new sectors are written.
+//
+//	Return FALSE, leaving the file as it was, if there is not enough
+//	free space -- counting the overflow extent sectors that the most
+//	extents the holes could be split into would take.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"from", "to" are the byte range of the file to be written
+//----------------------------------------------------------------------
+
+bool
+FileHeader::FillHoles(PersistentBitmap *freeMap, int from, int to)
+{
+    int first = from / SectorSize;
+    int last = divRoundUp(to, SectorSize);	// first block not filled
+    int needed = HoleSectors(from, to);
+    Extent *oldTable = extentTable;
+    int oldCount = numExtents;
+    int i, offset, length, lo, hi, most;
+
+    if (needed == 0)
+	return TRUE;
+    most = numExtents + needed;
+    for (i = 0; i < numExtents; i++)
+	if (extentTable[i].start == HoleSector)
+	    most += 2;			// pieces of the hole either side
+    if (freeMap->NumFree() < needed 
+		+ max(0, ChainSectorsNeeded(most) - numChainSectors))
+	return FALSE;
+
+    DEBUG(dbgFile, "Filling " << needed << " sectors of holes");
+    extentTable = NULL;
+    maxExtents = 0;
+    numExtents = 0;
+    for (i = offset = 0; i < oldCount; offset += length, i++) {
+	length = oldTable[i].length;
+	lo = max(offset, first);
+	hi = min(offset + length, last);
+	if (oldTable[i].start != HoleSector || lo >= hi) {
+	    AddExtent(oldTable[i].start, length);
+	    continue;
+	}
+	if (lo > offset)
+	    AddExtent(HoleSector, lo - offset);
+	AllocateRuns(freeMap, hi - lo);
+	if (hi < offset + length)
+	    AddExtent(HoleSector, offset + length - hi);
+    }
+    delete [] oldTable;
+    BuildOffsets();
+    ASSERT(GrowChain(freeMap));
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Truncate
+// 	Make the file "newSize" bytes long, returning the data blocks past
+//	the new end of the file, and any overflow extent sectors no longer
+//	needed, to the map of free disk blocks.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newSize" is the new length of the file, in bytes
+//----------------------------------------------------------------------
+
+void
+FileHeader::Truncate(PersistentBitmap *freeMap, int newSize)
+{
+    int keep = divRoundUp(newSize, SectorSize);
+    int needed;
+    Extent *last;
+
+    ASSERT(newSize <= numBytes);
+    if (numSectors == 0) {		// data kept in the header
+	if (headerData != NULL)
+	    memset(&headerData[newSize], 0, numBytes - newSize);
+	numBytes = newSize;
+	return;
+    }
+    while (numSectors > keep) {		// trim extents from the end
+	last = &extentTable[numExtents - 1];
+	while (last->length > 0 && numSectors > keep) {
+	    last->length--;
+	    numSectors--;
+	    if (last->start == HoleSector)
+		continue;		// nothing to free
+	    ASSERT(freeMap->Test(last->start + last->length));
+	    freeMap->Clear(last->start + last->length);
+	}
+	if (last->length == 0)
+	    numExtents--;
+    }
+    numBytes = newSize;
+    BuildOffsets();
+
+    needed = ChainSectorsNeeded(numExtents);
+    while (numChainSectors > needed) {
+	numChainSectors--;
+	ASSERT(freeMap->Test(chainTable[numChainSectors]));
+	freeMap->Clear(chainTable[numChainSectors]);
+    }
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
-// 	De-allocate all the space allocated for data blocks for this file.
+// 	De-allocate all the space allocated for data blocks and overflow
+//	extent sectors for this file.
 //
 //	"freeMap" is the bit map of free disk sectors
 //----------------------------------------------------------------------
@@ -93,15 +569,26 @@ FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 void 
 FileHeader::Deallocate(PersistentBitmap *freeMap)
 {
-    for (int i = 0; i < numSectors; i++) {
-		ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
-		freeMap->Clear((int) dataSectors[i]);
+    int i, j;
+
+    for (i = 0; i < numExtents; i++) {
+	if (extentTable[i].start == HoleSector)
+	    continue;
+	for (j = 0; j < extentTable[i].length; j++) {
+	    ASSERT(freeMap->Test(extentTable[i].start + j));  // ought to be marked!
+	    freeMap->Clear(extentTable[i].start + j);
+	}
+    }
+    for (i = 0; i < numChainSectors; i++) {
+	ASSERT(freeMap->Test(chainTable[i]));
+	freeMap->Clear(chainTable[i]);
     }
 }
 
 //----------------------------------------------------------------------
 // FileHeader::FetchFrom
-// 	Fetch contents of file header from disk. 
+// 	Fetch contents of file header from disk, along with any overflow
+//	extent sectors.
 //
 //	"sector" is the disk sector containing the file header
 //----------------------------------------------------------------------
@@ -109,18 +596,52 @@ FileHeader::Deallocate(PersistentBitmap *freeMap)
 void
 FileHeader::FetchFrom(int sector)
 {
-    kernel->synchDisk->ReadSector(sector, (char *)this);
-	
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you will need to rebuild the header's structure
-	*/
+    int *buf = new int[SectorSize / sizeof(int)];
+    Extent *inlineExtents = (Extent *) &buf[4];
+    Extent *chainExtents = (Extent *) &buf[2];
+    int i, j, next, count;
+
+    FreeTables();
+    kernel->blockCache->ReadSector(sector, (char *)buf);
+    numBytes = buf[0];
+    numSectors = buf[1];
+    numExtents = buf[2];
+    chainSector = buf[3];
 	
+    // rebuild the in-core part from the inline extents and the
+    // overflow chain
+    maxExtents = numExtents;
+    extentTable = new Extent[maxExtents];
+    count = min(numExtents, NumInlineExtents);
+    for (i = 0; i < count; i++)
+	extentTable[i] = inlineExtents[i];
+
+    if (numSectors == 0 && numBytes > 0) {	// data kept in the header
+	headerData = new char[MaxHeaderData];
+	bcopy((char *) &buf[4], headerData, MaxHeaderData);
+    }
+
+    numChainSectors = ChainSectorsNeeded(numExtents);
+    chainTable = new int[numChainSectors];
+    next = chainSector;
+    for (j = 0; j < numChainSectors; j++) {
+	chainTable[j] = next;
+	kernel->blockCache->ReadSector(next, (char *)buf);
+	next = buf[0];
+	count = buf[1];
+	ASSERT(i + count <= numExtents);
+	for (int k = 0; k < count; k++)
+	    extentTable[i++] = chainExtents[k];
+    }
+    ASSERT(i == numExtents);
+    delete [] buf;
+    BuildOffsets();
 }
 
 //----------------------------------------------------------------------
 // FileHeader::WriteBack
-// 	Write the modified contents of the file header back to disk. 
+// 	Write the modified contents of the file header back to disk,
+//	along with any overflow extent sectors.
 //
 //	"sector" is the disk sector to contain the file header
 //----------------------------------------------------------------------
@@ -128,17 +649,34 @@ FileHeader::FetchFrom(int sector)
 void
 FileHeader::WriteBack(int sector)
 {
-    kernel->synchDisk->WriteSector(sector, (char *)this); 
-	
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you may not want to write all fields into disk.
-		Use this instead:
-		char buf[SectorSize];
-		memcpy(buf + offset, &dataToBeWritten, sizeof(dataToBeWritten));
-		...
-	*/
-	
+    int *buf = new int[SectorSize / sizeof(int)];
+    Extent *inlineExtents = (Extent *) &buf[4];
+    Extent *chainExtents = (Extent *) &buf[2];
+    int i, j, count;
+
+    ASSERT(numChainSectors == ChainSectorsNeeded(numExtents));
+    chainSector = (numChainSectors > 0) ? chainTable[0] : -1;
+    memset(buf, -1, SectorSize);
+    buf[0] = numBytes;
+    buf[1] = numSectors;
+    buf[2] = numExtents;
+    buf[3] = chainSector;
+    count = min(numExtents, NumInlineExtents);
+    for (i = 0; i < count; i++)
+	inlineExtents[i] = extentTable[i];
+    if (numSectors == 0 && headerData != NULL)
+	bcopy(headerData, (char *) &buf[4], MaxHeaderData);
+    kernel->blockCache->WriteSector(sector, (char *)buf); 
+
+    for (j = 0; j < numChainSectors; j++) {
+	memset(buf, -1, SectorSize);
+	buf[0] = (j + 1 < numChainSectors) ? chainTable[j + 1] : -1;
+	buf[1] = min(numExtents - i, NumChainExtents);
+	for (int k = 0; k < buf[1]; k++)
+	    chainExtents[k] = extentTable[i++];
+	kernel->blockCache->WriteSector(chainTable[j], (char *)buf);
+    }
+    delete [] buf;
 }
 
 //----------------------------------------------------------------------
@@ -148,13 +686,97 @@ FileHeader::WriteBack(int sector)
 //	offset in the file) to a physical address (the sector where the
 //	data at the offset is stored).
 //
+//	Sequential access usually stays within the extent found last
+//	time, or moves to the next one; otherwise we binary search the
+//	in-core extent table.
+//
+//	A byte in a hole has no sector; HoleSector is returned.
+//
 //	"offset" is the location within the file of the byte in question
 //----------------------------------------------------------------------
 
 int
 FileHeader::ByteToSector(int offset)
 {
-    return(dataSectors[offset / SectorSize]);
+    int sector = offset / SectorSize;
+    int lo, hi, mid;
+
+    ASSERT(sector >= 0 && sector < numSectors);
+    if (sector < extentOffset[lastExtent] 
+		|| sector >= extentOffset[lastExtent] + extentTable[lastExtent].length) {
+	if (lastExtent + 1 < numExtents && sector >= extentOffset[lastExtent + 1]
+		&& sector < extentOffset[lastExtent + 1] + extentTable[lastExtent + 1].length) {
+	    lastExtent++;
+	} else {
+	    lo = 0;
+	    hi = numExtents - 1;
+	    while (lo < hi) {		// find last extent starting <= sector
+		mid = (lo + hi + 1) / 2;
+		if (extentOffset[mid] <= sector)
+		    lo = mid;
+		else
+		    hi = mid - 1;
+	    }
+	    lastExtent = lo;
+	}
+    }
+    if (extentTable[lastExtent].start == HoleSector)
+	return HoleSector;
+    return extentTable[lastExtent].start + (sector - extentOffset[lastExtent]);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::HoleSectors
+// 	Return how many of the blocks of the file holding bytes "from" up
+//	to "to" are in holes.
+//----------------------------------------------------------------------
+
+int
+FileHeader::HoleSectors(int from, int to)
+{
+    int first = from / SectorSize;
+    int last = divRoundUp(to, SectorSize);	// first block not counted
+    int count = 0;
+
+    if (numHoleSectors == 0)
+	return 0;
+    for (int i = 0; i < numExtents; i++)
+	if (extentTable[i].start == HoleSector)
+	    count += max(0, min(extentOffset[i] + extentTable[i].length, last)
+				- max(extentOffset[i], first));
+    return count;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::MarkSectors
+// 	Mark in "inUse" every sector the file occupies: its data sectors,
+//	and its overflow extent sectors.  Used to check the bitmap of free
+//	sectors against the files actually on disk.
+//
+//	Return the number of those sectors that were already marked, and
+//	so are claimed by some other file as well.
+//
+//	"inUse" -- the sectors found in use so far
+//----------------------------------------------------------------------
+
+int
+FileHeader::MarkSectors(Bitmap *inUse)
+{
+    int i, j, shared = 0;
+
+    for (i = 0; i < numExtents; i++)
+	for (j = 0; extentTable[i].start != HoleSector 
+			&& j < extentTable[i].length; j++) {
+	    if (inUse->Test(extentTable[i].start + j))
+		shared++;
+	    inUse->Mark(extentTable[i].start + j);
+	}
+    for (i = 0; i < numChainSectors; i++) {
+	if (inUse->Test(chainTable[i]))
+	    shared++;
+	inUse->Mark(chainTable[i]);
+    }
+    return shared;
 }
 
 //----------------------------------------------------------------------
@@ -168,6 +790,59 @@ FileHeader::FileLength()
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::Capacity
+// 	Return the number of bytes the file's data blocks can hold.  This
+//	is more than the length of the file if blocks have been reserved
+//	past its end.  A file with no data blocks can hold as much as
+//	fits in the header.
+//----------------------------------------------------------------------
+
+int
+FileHeader::Capacity()
+{
+    if (numSectors == 0)
+	return MaxHeaderData;
+    return numSectors * SectorSize;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DataInHeader
+// 	Return TRUE if the file's data is kept in the header, rather than
+//	in data sectors.  ByteToSector must not be used on such a file.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::DataInHeader()
+{
+    return numSectors == 0 && numBytes > 0;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ReadHeaderData/WriteHeaderData
+// 	Read/write part of the data of a file kept in the header.  Only
+//	the in-core header is changed; the caller writes it back.
+//
+//	"into" -- the buffer to contain the data read
+//	"from" -- the buffer containing the data to be written
+//	"numBytes" -- the number of bytes to transfer
+//	"position" -- the offset within the file of the first byte
+//----------------------------------------------------------------------
+
+void
+FileHeader::ReadHeaderData(char *into, int numBytes, int position)
+{
+    ASSERT(DataInHeader() && position + numBytes <= this->numBytes);
+    bcopy(&headerData[position], into, numBytes);
+}
+
+void
+FileHeader::WriteHeaderData(char *from, int numBytes, int position)
+{
+    ASSERT(DataInHeader() && position + numBytes <= this->numBytes);
+    bcopy(from, &headerData[position], numBytes);
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Print
 // 	Print the contents of the file header, and the contents of all
@@ -181,11 +856,26 @@ FileHeader::Print()
     char *data = new char[SectorSize];
 
     printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
-    for (i = 0; i < numSectors; i++)
-	printf("%d ", dataSectors[i]);
+    for (i = 0; i < numExtents; i++)
+	if (extentTable[i].start == HoleSector)
+	    printf("hole(%d) ", extentTable[i].length);
+	else
+	    printf("%d-%d ", extentTable[i].start, 
+			extentTable[i].start + extentTable[i].length - 1);
+    if (numChainSectors > 0) {
+	printf("\nExtent blocks:\n");
+	for (i = 0; i < numChainSectors; i++)
+	    printf("%d ", chainTable[i]);
+    }
     printf("\nFile contents:\n");
-    for (i = k = 0; i < numSectors; i++) {
-	kernel->synchDisk->ReadSector(dataSectors[i], data);
+    for (i = k = 0; k < numBytes; i++) {	// not any sectors reserved
+	if (DataInHeader())
+	    bcopy(headerData, data, MaxHeaderData);
+	else if (ByteToSector(i * SectorSize) == HoleSector)
+	    memset(data, 0, SectorSize);
+	else
+	    kernel->blockCache->ReadSector(ByteToSector(i * SectorSize), 
+			data);
         for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
 	    if ('\040' <= data[j] && data[j] <= '\176')   // isprint(data[j])
 		printf("%c", data[j]);
@@ -17,19 +17,64 @@
 #include "disk.h"
 #include "pbitmap.h"
 
-#define NumDirect 	((SectorSize - 2 * sizeof(int)) / sizeof(int))
-#define MaxFileSize 	(NumDirect * SectorSize)
+// The following class defines an "extent" -- a run of consecutive
+// disk sectors holding consecutive data blocks of a file, or a "hole"
+// -- a run of data blocks of the file that have never been written,
+// and so have no disk sectors.
+//
+// Internal data structures kept public so that FileHeader operations
+// can access them directly.
+
+class Extent {
+  public:
+    int start;				// First disk sector of the run, or
+					// HoleSector
+    int length;				// Number of sectors in the run
+};
+
+#define NumInlineExtents ((int) ((SectorSize - 4 * sizeof(int)) / sizeof(Extent)))
+					// extents stored in the header itself
+#define NumChainExtents	((int) ((SectorSize - 2 * sizeof(int)) / sizeof(Extent)))
+					// extents stored in each overflow
+					// extent sector
+#define HoleSector	-1		// where the blocks of a hole are
+#define MaxHeaderData	((int) (SectorSize - 4 * sizeof(int)))
+					// bytes of data a small file keeps
+					// in the header, in place of the
+					// extents
 
 // The following class defines the Nachos "file header" (in UNIX terms,  
 // the "i-node"), describing where on disk to find all of the data in the file.
-// The file header is organized as a simple table of pointers to
-// data blocks. 
+// The file header is organized as a list of extents, in file order.
+// The first NumInlineExtents extents are kept in the header sector;
+// if a file needs more, the rest spill into a chain of overflow extent
+// sectors, each holding the sector number of the next one, a count,
+// and NumChainExtents extents.
+//
+// Since the allocator looks for runs of free sectors, a file written
+// onto a mostly empty disk is described by only a handful of extents,
+// and reading it sequentially rarely moves the disk head to a new track.
+//
+// A file may be sparse: a file created with an initial size gets a
+// hole rather than data sectors, and blocks are only given sectors
+// when they are first written.  Blocks of a hole read as zeros.
+//
+// A file of no more than MaxHeaderData bytes has no data sectors at
+// all: its data is kept in the header sector, where the extents would
+// go, so that it is read and written along with the header.  Such a
+// file has a length but no sectors.  When it grows too big, its data
+// is moved out to a newly allocated data sector.
 //
 // The file header data structure can be stored in memory or on disk.
-// When it is on disk, it is stored in a single sector -- this means
-// that we assume the size of this data structure to be the same
-// as one disk sector.  Without indirect addressing, this
-// limits the maximum file length to just under 4K bytes.
+// When it is on disk, it is stored in a single sector, as four counts
+// followed by as many extents as fit; since the sector size is chosen
+// when the disk is formatted, FetchFrom and WriteBack copy the header
+// through a sector-sized buffer.
+//
+// While a header is in memory, the whole extent list is kept in an
+// in-core table along with the file offset at which each extent
+// begins, so that translating a file offset never has to read an
+// overflow sector off the disk.
 //
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
@@ -41,11 +86,33 @@ class FileHeader {
 	FileHeader(); // dummy constructor to keep valgrind happy
 	~FileHeader();
 	
-    bool Allocate(PersistentBitmap *bitMap, int fileSize);// Initialize a file header, 
+    bool Allocate(PersistentBitmap *bitMap, int fileSize, 
+			bool sparse = FALSE);
+						// Initialize a file header, 
 						//  including allocating space 
-						//  on disk for the file data
+						//  on disk for the file data,
+						//  unless "sparse"
     void Deallocate(PersistentBitmap *bitMap);  // De-allocate this file's 
-						//  data blocks
+						//  data blocks and overflow
+						//  extent sectors
+    bool Extend(PersistentBitmap *bitMap, int newSize, int reserve = 0,
+			bool sparse = FALSE);
+						// Make the file longer,
+						//  allocating more data blocks,
+						//  and if there is room,
+						//  "reserve" more past the end,
+						//  or leaving them in a hole
+						//  if "sparse"
+    int MaxSectorsToExtend(int newSize);	// Most free sectors Extend
+						//  could take
+    bool FillHoles(PersistentBitmap *bitMap, int from, int to);
+						// Allocate data blocks for
+						//  the holes between "from"
+						//  and "to"
+    void Truncate(PersistentBitmap *bitMap, int newSize);
+						// Make the file shorter, 
+						//  freeing data blocks past
+						//  the new end
 
     void FetchFrom(int sectorNumber); 	// Initialize file header from disk
     void WriteBack(int sectorNumber); 	// Write modifications to file header
@@ -53,10 +120,23 @@ class FileHeader {
 
     int ByteToSector(int offset);	// Convert a byte offset into the file
 					// to the disk sector containing
-					// the byte
+					// the byte, or HoleSector
+    int HoleSectors(int from, int to);	// How many blocks between "from"
+					// and "to" are in holes
 
-    int FileLength();			// Return the length of the file 
+    int FileLength();			// Return the length of the file
 					// in bytes
+    int Capacity();			// Return how long the file can grow
+					// without more data blocks
+    bool DataInHeader();		// Is the data kept in the header?
+    void ReadHeaderData(char *into, int numBytes, int position);
+    void WriteHeaderData(char *from, int numBytes, int position);
+					// Read/write the data of a file
+					// kept in the header
+
+    int MarkSectors(Bitmap *inUse);	// Mark every sector the file 
+					//  occupies; return how many were
+					//  already marked
 
     void Print();			// Print the contents of the file.
 
@@ -71,16 +151,52 @@ class FileHeader {
 		In order to implement a data structure, you will need to add some "in-core" data
 		to maintain data structure.
 		
-		Disk Part - numBytes, numSectors, dataSectors occupy exactly 128 bytes and will be
-		written to a sector on disk.
-		In-core part - none
+		Disk Part - numBytes, numSectors, numExtents, chainSector, and the
+		first extents of the file (or a small file's data) fill exactly
+		one sector on disk, whatever the sector size of the disk.
+		In-core part - extentTable, maxExtents, extentOffset,
+		chainTable, numChainSectors, lastExtent, headerData,
+		numHoleSectors
 		
 	*/
 	
     int numBytes;			// Number of bytes in the file
-    int numSectors;			// Number of data sectors in the file
-    int dataSectors[NumDirect];		// Disk sector numbers for each data 
-					// block in the file
+    int numSectors;			// Number of data blocks in the file,
+					// including those in holes
+    int numExtents;			// Number of extents in the file
+    int chainSector;			// First overflow extent sector, or -1
+					// (followed on disk by the first
+					// NumInlineExtents extents)
+
+    Extent *extentTable;		// In-core: every extent of the file
+    int maxExtents;			// In-core: room in extentTable
+    int *extentOffset;			// In-core: file sector at which each
+					// extent begins
+    int *chainTable;			// In-core: the overflow extent sectors
+    int numChainSectors;		// In-core: entries in chainTable
+    int lastExtent;			// In-core: extent found by the last
+					// ByteToSector, tried first next time
+    char *headerData;			// In-core: the data of a file kept
+					// in the header, or NULL
+    int numHoleSectors;			// In-core: how many of numSectors
+					// are in holes
+
+    void AddExtent(int start, int length);
+					// Append a run of sectors to the
+					// in-core extent table
+    void AllocateRuns(PersistentBitmap *bitMap, int count);
+					// Allocate "count" sectors, in runs
+					// as long as possible, and append
+					// them to the extent table
+    bool ExtendSparse(PersistentBitmap *bitMap, int newSize);
+					// Extend the file with a hole
+    bool GrowChain(PersistentBitmap *bitMap);
+					// Allocate the overflow extent
+					// sectors the extents need
+    void BuildOffsets();		// Fill in extentOffset
+    void FreeTables();			// De-allocate the in-core tables
+    void MoveHeaderData();		// Move data kept in the header out
+					// to the first data sector
 };
 
 #endif // FILEHDR_H
@@ -19,25 +19,40 @@
 //	on bootup.
 //
 //	The file system assumes that the bitmap and directory files are
-//	kept "open" continuously while Nachos is running.
+//	kept "open" continuously while Nachos is running.  The directory
+//	itself is also kept in memory, so that looking up a name does not
+//	go to the disk; only the parts of it that change are written back.
+//
+//	A file may itself be a directory, and files are named by a path
+//	from the root directory, such as "/t0/bb/f3".  Other directories
+//	are read in when needed, but the result of each lookup of a path
+//	component is remembered in a dentry cache (cf. dcache.h), so that
+//	resolving a path does not read in every directory along the way.
+//
+//	The bitmap is kept in memory too, and only the sectors of it that
+//	change are written back.
 //
 //	For those operations (such as Create, Remove) that modify the
 //	directory and/or bitmap, if the operation succeeds, the changes
-//	are written immediately back to disk (the two files are kept
-//	open during all this time).  If the operation fails, and we have
-//	modified part of the directory and/or bitmap, we simply discard
-//	the changed version, without writing it back to disk.
+//	are written immediately back (the two files are kept open during
+//	all this time).  If the operation fails, and we have modified
+//	part of the directory and/or bitmap, we undo the changes to the
+//	in-memory copies, without writing anything back.
+//
+//	Everything an operation writes is logged in a journal (cf.
+//	journal.h), and reaches its home on disk only once the journal
+//	has committed it, so that if Nachos exits in the middle of an
+//	operation, the operation is either replayed in full, or not at
+//	all, the next time the file system is mounted.
 //
 // 	Our implementation at this point has the following restrictions:
 //
 //	   there is no synchronization for concurrent accesses
-//	   files have a fixed size, set when the file is created
-//	   files cannot be bigger than about 3KB in size
-//	   there is no hierarchical directory structure, and only a limited
-//	     number of files can be added to the system
-//	   there is no attempt to make the system robust to failures
-//	    (if Nachos exits in the middle of an operation that modifies
-//	    the file system, it may corrupt the disk)
+//	   files grow when written past their end, but never shrink
+//	   files cannot be bigger than the free space on disk
+//	   only the latest operations, not yet committed by the journal,
+//	    are lost if Nachos exits in the middle of them; the data
+//	    written to a file is not journaled
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -51,19 +66,33 @@
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
-
-// Sectors containing the file headers for the bitmap of free sectors,
-// and the directory of files.  These file headers are placed in well-known 
-// sectors, so that they can be located on boot-up.
-#define FreeMapSector 		0
-#define DirectorySector 	1
-
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number 
-// of files that can be loaded onto the disk.
-#define FreeMapFileSize 	(NumSectors / BitsInByte)
-#define NumDirEntries 		10
-#define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
+#include "dcache.h"
+#include "inode.h"
+#include "superblock.h"
+#include "journal.h"
+#include "blockcache.h"
+#include "list.h"
+#include "main.h"
+
+// The journal is placed just after the well-known sectors, and takes a
+// small fraction of the disk, but always has room for a few operations
+// at once.  An operation writes at most the whole bitmap, plus a few
+// headers, overflow extent sectors and directory chunks.
+#define JournalStart 		(DirectorySector + 1)
+#define OperationSectors 	((int) divRoundUp(FreeMapFileSize, SectorSize) + 16)
+#define JournalSectors 		max(max(MinJournalSectors, NumSectors / 32), \
+					4 * OperationSectors + 1)
+
+// Initial file sizes for the bitmap and directory.  The bitmap is stored
+// a word at a time.  The directory starts out as a single chunk of
+// entries, and grows as files are added.
+#define FreeMapFileSize 	(divRoundUp(NumSectors, BitsInWord) * sizeof(unsigned))
+#define NumDirEntries 		NumChunkEntries
+#define DirectoryFileSize 	SectorSize
+
+// How many directories besides the root are kept in memory once they
+// have been read in.
+#define NumResidentDirs		16
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
@@ -72,8 +101,11 @@
 //	an empty directory, and a bitmap of free sectors (with almost but
 //	not all of the sectors marked as free).  
 //
-//	If format = FALSE, we just have to open the files
-//	representing the bitmap and the directory.
+//	If format = FALSE, we just have to replay anything committed to
+//	the journal but not yet written home, and open the files
+//	representing the bitmap and the directory.  Only if the file
+//	system was not cleanly unmounted is the bitmap checked against
+//	the files on disk.
 //
 //	"format" -- should we initialize the disk?
 //----------------------------------------------------------------------
@@ -81,18 +113,31 @@
 FileSystem::FileSystem(bool format)
 { 
     DEBUG(dbgFile, "Initializing the file system.");
+    dentries = new DentryCache(NumDentries);
+    residentDirs = new ::List<Inode *>;
+    super = new SuperBlock;
     if (format) {
-        PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
-        Directory *directory = new Directory(NumDirEntries);
 		FileHeader *mapHdr = new FileHeader;
 		FileHeader *dirHdr = new FileHeader;
 
         DEBUG(dbgFile, "Formatting the file system.");
+        freeMap = new PersistentBitmap(NumSectors);
+        directory = new Directory(NumDirEntries);
 
-		// First, allocate space for FileHeaders for the directory and bitmap
-		// (make sure no one else grabs these!)
+		// First, allocate space for the superblock, and FileHeaders for
+		// the directory and bitmap (make sure no one else grabs these!),
+		// and for the journal
+		freeMap->Mark(SuperBlockSector);	    
 		freeMap->Mark(FreeMapSector);	    
 		freeMap->Mark(DirectorySector);
+		for (int i = 0; i < JournalSectors; i++)
+		    freeMap->Mark(JournalStart + i);
+		super->journalStart = JournalStart;
+		super->journalSectors = JournalSectors;
+		super->numHeaders = 2;
+		journal = new Journal(JournalStart, JournalSectors,
+				      OperationSectors);
+		journal->Format();
 
 		// Second, allocate space for the data blocks containing the contents
 		// of the directory and bitmap files.  There better be enough space!
@@ -106,6 +151,7 @@ FileSystem::FileSystem(bool format)
 		// on it!).
 
         DEBUG(dbgFile, "Writing headers back to disk.");
+		super->WriteBack(SuperBlockSector);
 		mapHdr->WriteBack(FreeMapSector);    
 		dirHdr->WriteBack(DirectorySector);
 
@@ -130,96 +176,497 @@ FileSystem::FileSystem(bool format)
 			freeMap->Print();
 			directory->Print();
         }
-        delete freeMap; 
-		delete directory; 
 		delete mapHdr; 
 		delete dirHdr;
+		kernel->blockCache->SetJournal(journal);
     } else {
-		// if we are not formatting the disk, just open the files representing
-		// the bitmap and directory; these are left open while Nachos is running
+		// if we are not formatting the disk, check that it holds a file
+		// system built for a disk of this geometry, then just open the
+		// files representing the bitmap and directory; these are left
+		// open while Nachos is running
+		super->FetchFrom(SuperBlockSector);
+		ASSERT(super->Matches());
+		journal = new Journal(super->journalStart, super->journalSectors,
+				      OperationSectors);
+		journal->Recover();
+		kernel->blockCache->SetJournal(journal);
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
+        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+        directory = new Directory(NumDirEntries);
+        directory->FetchFrom(directoryFile);
+
+		// if the file system was not cleanly unmounted, the bitmap may 
+		// not agree with the files on disk, and the counts in the
+		// superblock are out of date; otherwise, there is nothing to do
+		if (!super->clean || super->freeSectors != freeMap->NumClear())
+		    Check();
+		else
+		    DEBUG(dbgFile, "Clean file system, " << super->freeSectors 
+			<< " sectors free, " << super->numHeaders << " file headers");
+
+		// until we unmount, the file system is not clean
+		super->clean = FALSE;
+		super->WriteBack(SuperBlockSector);
+		kernel->blockCache->Flush();
     }
 }
 
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileSystem::~FileSystem
+//	Give sectors to the data still waiting in files left open, and
+//	close the bitmap and directory files, commit the operations
+//	still in the journal, and flush every sector still dirty in the
+//	block cache, so that nothing is lost when Nachos halts.  The
+//	journal is left empty.  Finally, record in the superblock that
+//	the file system was cleanly unmounted.
 //----------------------------------------------------------------------
 FileSystem::~FileSystem()
 {
+	Sync();				// before the inode table goes
+	super->freeSectors = freeMap->NumClear();
+	while (!residentDirs->IsEmpty())
+	    kernel->inodeTable->Release(residentDirs->RemoveFront());
+	delete residentDirs;
+	delete dentries;
+	delete directory;
+	delete freeMap;
 	delete freeMapFile;
 	delete directoryFile;
+	journal->Commit();
+	journal->Checkpoint();
+	kernel->blockCache->SetJournal(NULL);
+	delete journal;
+	super->clean = TRUE;
+	super->WriteBack(SuperBlockSector);
+	kernel->blockCache->Flush();
+	delete super;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Sync
+// 	Commit every operation so far to the journal, so that it survives
+//	Nachos exiting unexpectedly (similar to UNIX sync).  Data written
+//	to the end of open files is given its sectors first, and their
+//	headers written back, so that the new lengths are committed too.
+//----------------------------------------------------------------------
+
+void
+FileSystem::Sync()
+{
+    OpenFile *file;
+    int sector;
+
+    while ((sector = kernel->inodeTable->FindDelayed()) >= 0) {
+	file = new OpenFile(sector);
+	file->Flush();
+	journal->Begin();
+	file->WriteBackHeader();
+	journal->End();
+	delete file;
+    }
+    journal->Commit();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Check
+// 	Make the bitmap of free sectors agree with the files on disk, when
+//	the file system was not cleanly unmounted.  Only the metadata is
+//	read: walk the directory tree from the root, marking every file
+//	header reached and every sector its header says it occupies, then
+//	compare with the bitmap.
+//
+//	A sector in use but marked free would be handed out twice, so
+//	it is marked; a sector marked but in no file is leaked, so it is
+//	freed.  A sector claimed by two files can't be fixed here; it is
+//	only reported.  The counts in the superblock are brought up to
+//	date.
+//----------------------------------------------------------------------
+
+void
+FileSystem::Check()
+{
+    Bitmap *inUse = new Bitmap(NumSectors);
+    int headers = 0, shared, lost = 0, leaked = 0;
+
+    DEBUG(dbgFile, "File system not cleanly unmounted, checking.");
+    inUse->Mark(SuperBlockSector);
+    for (int i = 0; i < super->journalSectors; i++)
+	inUse->Mark(super->journalStart + i);
+    shared = CheckFile(FreeMapSector, FALSE, inUse, &headers)
+		+ CheckFile(DirectorySector, TRUE, inUse, &headers);
+
+    for (int i = 0; i < NumSectors; i++) {
+	if (inUse->Test(i) && !freeMap->Test(i)) {
+	    freeMap->Mark(i);
+	    lost++;
+	} else if (!inUse->Test(i) && freeMap->Test(i)) {
+	    freeMap->Clear(i);
+	    leaked++;
+	}
+    }
+    if (lost > 0 || leaked > 0) {
+	journal->Begin();
+	freeMap->WriteBack(freeMapFile);
+	journal->End();
+	journal->Commit();
+    }
+    if (lost > 0 || leaked > 0 || shared > 0)
+	cerr << "File system check: " << lost << " sectors in use marked free, "
+		<< leaked << " leaked, " << shared << " shared\n";
+    DEBUG(dbgFile, "Checked " << headers << " file headers, " 
+		<< freeMap->NumClear() << " sectors free");
+    super->numHeaders = headers;
+    super->freeSectors = freeMap->NumClear();
+    delete inUse;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CheckFile
+// 	Mark the header of a file, and the sectors it occupies, in use;
+//	if it is a directory, do the same for everything in it.  Return 
+//	the number of sectors found to be claimed twice.
+//
+//	"sector" -- location of the file's header
+//	"isDir" -- is the file a directory?
+//	"inUse" -- the sectors found in use so far
+//	"headers" -- incremented for each file header found
+//----------------------------------------------------------------------
+
+int
+FileSystem::CheckFile(int sector, bool isDir, Bitmap *inUse, int *headers)
+{
+    Directory *dir;
+    OpenFile *dirFile;
+    Inode *inode;
+    int shared, position = 0, child;
+    bool childIsDir;
+
+    if (inUse->Test(sector))		// two headers in one sector, or a
+	return 1;			// directory reached twice
+    inUse->Mark(sector);
+    (*headers)++;
+    inode = kernel->inodeTable->Acquire(sector);
+    shared = inode->hdr->MarkSectors(inUse);
+    kernel->inodeTable->Release(inode);
+    if (isDir) {
+	dir = FetchDirectory(sector, &dirFile);
+	while ((child = dir->NextEntry(&position, &childIsDir)) != -1)
+	    shared += CheckFile(child, childIsDir, inUse, headers);
+	ReleaseDirectory(dir, dirFile);
+    }
+    return shared;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FetchDirectory
+// 	Bring the directory whose header is in "sector" into memory, and
+//	open the file holding it.  Call ReleaseDirectory when done with it.
+//
+//	The root directory is always in memory already.  Any other
+//	directory is read in only once, and its contents kept with its
+//	in-core header, which is shared by every user of the directory.
+//	The headers of the NumResidentDirs directories used most recently
+//	are held on to, so that they stay in memory between operations.
+//	The in-memory copy is the one every change is made to, so it
+//	never goes stale.
+//
+//	"sector" -- location of the directory's file header
+//	"file" -- set to the open directory file
+//----------------------------------------------------------------------
+
+Directory *
+FileSystem::FetchDirectory(int sector, OpenFile **file)
+{
+    Directory *dir;
+    Inode *inode;
+
+    if (sector == DirectorySector) {
+	*file = directoryFile;
+	return directory;
+    }
+    *file = new OpenFile(sector);
+    inode = kernel->inodeTable->Acquire(sector);
+    if (inode->dir == NULL) {
+	dir = new Directory(NumDirEntries);
+	dir->FetchFrom(*file);		// may wait for the disk
+	if (inode->dir == NULL)
+	    inode->dir = dir;
+	else
+	    delete dir;			// someone else read it in meanwhile
+    }
+    if (residentDirs->IsInList(inode)) {
+	residentDirs->Remove(inode);	// already held; now most recent
+	residentDirs->Append(inode);
+	kernel->inodeTable->Release(inode);
+    } else {
+	residentDirs->Append(inode);
+	if ((int) residentDirs->NumInList() > NumResidentDirs)
+	    kernel->inodeTable->Release(residentDirs->RemoveFront());
+    }
+    return inode->dir;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReleaseDirectory
+// 	Done with a directory brought in by FetchDirectory.  Any changes
+//	must already have been written back.  The directory itself stays
+//	with its in-core header.
+//----------------------------------------------------------------------
+
+void
+FileSystem::ReleaseDirectory(Directory *dir, OpenFile *file)
+{
+    if (dir != directory)
+	delete file;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ForgetDirectory
+// 	A directory is being deleted; stop holding on to its in-core
+//	header, so that it and the directory in memory are de-allocated
+//	once the last user is done with them.
+//
+//	"inode" -- the in-core header of the directory
+//----------------------------------------------------------------------
+
+void
+FileSystem::ForgetDirectory(Inode *inode)
+{
+    if (residentDirs->IsInList(inode)) {
+	residentDirs->Remove(inode);
+	kernel->inodeTable->Release(inode);
+    }
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Lookup
+// 	Look up a single path component in a directory, and return the
+//	sector of the file's header, or -1 if it is not there.  The
+//	directory is only read in if the dentry cache does not already
+//	know the answer.
+//
+//	"dirSector" -- location of the directory's file header
+//	"name" -- the path component to look up
+//	"isDir" -- set to whether the file found is a directory
+//----------------------------------------------------------------------
+
+int
+FileSystem::Lookup(int dirSector, char *name, bool *isDir)
+{
+    Directory *dir;
+    OpenFile *dirFile;
+    int sector;
+
+    if (dentries->Lookup(dirSector, name, &sector, isDir))
+	return sector;
+
+    dir = FetchDirectory(dirSector, &dirFile);
+    sector = dir->Find(name);
+    *isDir = dir->IsDirectory(name);
+    ReleaseDirectory(dir, dirFile);
+    dentries->Enter(dirSector, name, sector, *isDir);
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ResolveParent
+// 	Walk a path name from the root directory, and return the sector
+//	of the directory that holds (or would hold) its last component.
+//	Return -1 if some component before the last is not a directory.
+//
+//	Empty components are ignored, so "/t0//bb/" names the same file
+//	as "/t0/bb".  As in a directory, only the first FileNameMaxLen 
+//	characters of each component count.
+//
+//	"path" -- the path name to resolve
+//	"leaf" -- set to the last component, or to "" if "path" names
+//		the root directory; must have room for FileNameMaxLen + 1
+//		characters
+//----------------------------------------------------------------------
+
+int
+FileSystem::ResolveParent(char *path, char *leaf)
+{
+    int parent = DirectorySector;
+    bool isDir = TRUE;
+    int len;
+
+    leaf[0] = '\0';
+    for (;;) {
+	while (*path == '/')
+	    path++;
+	if (*path == '\0')
+	    break;			// "leaf" was the last component
+	if (leaf[0] != '\0') {		// "leaf" must be a directory
+	    parent = Lookup(parent, leaf, &isDir);
+	    if (parent == -1 || !isDir)
+		return -1;
+	}
+	for (len = 0; path[len] != '/' && path[len] != '\0'; len++)
+	    ;
+	strncpy(leaf, path, min(len, FileNameMaxLen));
+	leaf[min(len, FileNameMaxLen)] = '\0';
+	path += len;
+    }
+    return parent;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Resolve
+// 	Return the sector of the header of the file named by "path", or
+//	-1 if there is no such file.
+//
+//	"path" -- the path name to resolve
+//	"isDir" -- set to whether the file is a directory
+//----------------------------------------------------------------------
+
+int
+FileSystem::Resolve(char *path, bool *isDir)
+{
+    char leaf[FileNameMaxLen + 1];
+    int parent = ResolveParent(path, leaf);
+
+    if (parent == -1)
+	return -1;
+    if (leaf[0] == '\0') {		// the root directory
+	*isDir = TRUE;
+	return DirectorySector;
+    }
+    return Lookup(parent, leaf, isDir);
 }
 
 //----------------------------------------------------------------------
 // FileSystem::Create
 // 	Create a file in the Nachos file system (similar to UNIX create).
-//	Since we can't increase the size of files dynamically, we have
-//	to give Create the initial size of the file.
+//	The file starts out "initialSize" bytes long, all of it a hole:
+//	no data blocks are allocated until they are written, and until
+//	then they read as zeros.
+//
+//	"name" -- path name of file to be created
+//	"initialSize" -- size of file to be created
+//----------------------------------------------------------------------
+
+bool
+FileSystem::Create(char *name, int initialSize)
+{
+    return CreateFile(name, initialSize, FALSE);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CreateDirectory
+// 	Create an empty directory in the Nachos file system (similar to
+//	UNIX mkdir).
+//
+//	"name" -- path name of directory to be created
+//----------------------------------------------------------------------
+
+bool
+FileSystem::CreateDirectory(char *name)
+{
+    return CreateFile(name, DirectoryFileSize, TRUE);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CreateFile
+// 	Create a file or a directory.
 //
 //	The steps to create a file are:
+//	  Find the directory to put it in
 //	  Make sure the file doesn't already exist
 //        Allocate a sector for the file header
-// 	  Allocate space on disk for the data blocks for the file
+// 	  Allocate space on disk for the data blocks for a directory
+//	    (a file's are left as a hole)
 //	  Add the name to the directory
+//	  Grow the directory file, if the directory grew
 //	  Store the new file header on disk 
+//	  If it is a directory, store an empty directory in it
 //	  Flush the changes to the bitmap and the directory back to disk
 //
+//	All of this is done as a single operation of the journal.
+//
 //	Return TRUE if everything goes ok, otherwise, return FALSE.
 //
 // 	Create fails if:
+//		some directory along the path does not exist
 //   		file is already in directory
 //	 	no free space for file header
-//	 	no free entry for file in directory
 //	 	no free space for data blocks for the file 
+//	 	no free space to grow the directory
 //
 // 	Note that this implementation assumes there is no concurrent access
 //	to the file system!
 //
-//	"name" -- name of file to be created
+//	"name" -- path name of file to be created
 //	"initialSize" -- size of file to be created
+//	"isDir" -- is the file a directory?
 //----------------------------------------------------------------------
 
 bool
-FileSystem::Create(char *name, int initialSize)
+FileSystem::CreateFile(char *name, int initialSize, bool isDir)
 {
-    Directory *directory;
-    PersistentBitmap *freeMap;
+    char leaf[FileNameMaxLen + 1];
+    Directory *dir;
+    OpenFile *dirFile;
     FileHeader *hdr;
-    int sector;
+    int parent, sector;
     bool success;
 
-    DEBUG(dbgFile, "Creating file " << name << " size " << initialSize);
-
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-
-    if (directory->Find(name) != -1)
-      success = FALSE;			// file is already in directory
-    else {	
-        freeMap = new PersistentBitmap(freeMapFile,NumSectors);
-        sector = freeMap->FindAndSet();	// find a sector to hold the file header
-    	if (sector == -1) 		
-            success = FALSE;		// no free block for file header 
-        else if (!directory->Add(name, sector))
-            success = FALSE;	// no space in directory
-	else {
-    	    hdr = new FileHeader;
-	    if (!hdr->Allocate(freeMap, initialSize))
-            	success = FALSE;	// no space on disk for data
-	    else {	
-	    	success = TRUE;
-		// everthing worked, flush all changes back to disk
-    	    	hdr->WriteBack(sector); 		
-    	    	directory->WriteBack(directoryFile);
-    	    	freeMap->WriteBack(freeMapFile);
+    DEBUG(dbgFile, "Creating " << (isDir ? "directory " : "file ") << name 
+		<< " size " << initialSize);
+
+    parent = ResolveParent(name, leaf);
+    if (parent == -1 || leaf[0] == '\0')
+	return FALSE;			// no such directory
+
+    journal->Begin();
+    dir = FetchDirectory(parent, &dirFile);
+    if (dir->Find(leaf) != -1) {
+	ReleaseDirectory(dir, dirFile);
+	journal->End();
+	return FALSE;			// file is already in directory
+    }
+    if (freeMap->NumFree() > 0)		// find a sector to hold the file header
+	sector = freeMap->FindAndSet();
+    else
+	sector = -1;
+    if (sector == -1) 		
+	success = FALSE;		// no free block for file header 
+    else {
+	dir->Add(leaf, sector, isDir);
+	hdr = new FileHeader;
+	if (!hdr->Allocate(freeMap, initialSize, !isDir))
+	    success = FALSE;		// no space on disk for data
+	else if (!dirFile->Resize(freeMap, dir->FileSize()))
+	    success = FALSE;		// no space to grow the directory
+	else {	
+	    success = TRUE;
+	    // everthing worked, flush all changes back to disk
+	    hdr->WriteBack(sector); 		
+	    if (isDir) {
+		Directory *newDir = new Directory(NumDirEntries);
+		OpenFile *newDirFile = new OpenFile(sector);
+
+		newDir->WriteBack(newDirFile);
+		delete newDir;
+		delete newDirFile;
 	    }
-            delete hdr;
+	    dir->WriteBack(dirFile);
+	    dirFile->WriteBackHeader();
+	    freeMap->WriteBack(freeMapFile);
+	    dentries->Enter(parent, leaf, sector, isDir);
+	    super->numHeaders++;
+	}
+	if (!success) {			// undo the in-memory changes
+	    dir->Remove(leaf);
+	    hdr->Deallocate(freeMap);
+	    freeMap->Clear(sector);
 	}
-        delete freeMap;
+	delete hdr;
     }
-    delete directory;
+    ReleaseDirectory(dir, dirFile);
+    journal->End();
     return success;
 }
 
@@ -227,106 +674,239 @@ FileSystem::Create(char *name, int initialSize)
 // FileSystem::Open
 // 	Open a file for reading and writing.  
 //	To open a file:
-//	  Find the location of the file's header, using the directory 
+//	  Find the location of the file's header, by walking the path
 //	  Bring the header into memory
 //
-//	"name" -- the text name of the file to be opened
+//	"name" -- the path name of the file to be opened
 //----------------------------------------------------------------------
 
 OpenFile *
 FileSystem::Open(char *name)
 { 
-    Directory *directory = new Directory(NumDirEntries);
     OpenFile *openFile = NULL;
+    bool isDir;
     int sector;
 
     DEBUG(dbgFile, "Opening file" << name);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name); 
+    sector = Resolve(name, &isDir); 
     if (sector >= 0) 		
 	openFile = new OpenFile(sector);	// name was found in directory 
-    delete directory;
-    opfile = openFile;
     return openFile;				// return NULL if not found
 }
 
-int 
-FileSystem::Read(char *buffer, int size, int id)
+//----------------------------------------------------------------------
+// FileSystem::Resize
+// 	Change the length of an open file, allocating sectors for it or
+//	freeing them, as a single operation of the journal.  A growing
+//	file also reserves "reserve" sectors past its new end, if there
+//	is room, unless it is "sparse" growth, which leaves the new part
+//	of the file in a hole.  Only the bitmap is written back now; the
+//	file header goes to disk when the file is last closed.
+//
+//	Return FALSE, leaving the file unchanged, if the disk is full.
+//
+//	"file" -- the open file
+//	"newLength" -- its new length, in bytes
+//	"reserve" -- sectors to reserve past the new end
+//	"sparse" -- whether to leave the new sectors unallocated
+//----------------------------------------------------------------------
+
+bool
+FileSystem::Resize(OpenFile *file, int newLength, int reserve, bool sparse)
 {
-    return opfile->Read(buffer, size);
+    bool success;
+
+    DEBUG(dbgFile, "Resizing file to " << newLength << " bytes, reserving "
+		<< reserve << " sectors");
+    journal->Begin();
+    success = file->Resize(freeMap, newLength, reserve, sparse);
+    if (success)
+	freeMap->WriteBack(freeMapFile);
+    journal->End();
+    return success;
 }
 
-int 
-FileSystem::Write(char *buffer, int size, int id)
+//----------------------------------------------------------------------
+// FileSystem::FillHoles
+// 	Give sectors to the blocks of an open file that are in holes,
+//	between byte "from" and byte "to", before they are written, as a
+//	single operation of the journal.  As for Resize, the file header
+//	goes to disk when the file is last closed.
+//
+//	Return FALSE, leaving the file unchanged, if the disk is full.
+//
+//	"file" -- the open file
+//	"from", "to" -- the byte range about to be written
+//----------------------------------------------------------------------
+
+bool
+FileSystem::FillHoles(OpenFile *file, int from, int to)
 {
-    return opfile->Write(buffer, size);
+    bool success;
+
+    journal->Begin();
+    success = file->FillHoles(freeMap, from, to);
+    if (success)
+	freeMap->WriteBack(freeMapFile);
+    journal->End();
+    return success;
 }
 
-int 
-FileSystem::Close(int id)
+//----------------------------------------------------------------------
+// FileSystem::HoldSectors
+// 	Set aside "count" free sectors for data of an open file that is
+//	kept in memory until it is given sectors, so that no one else can
+//	take them meanwhile (cf. OpenFile::Delay).  They are given back
+//	when the file is resized to take the data, or removed.
+//
+//	Return FALSE, setting none aside, if there are not that many.
+//
+//	"count" -- how many sectors to hold
+//----------------------------------------------------------------------
+
+bool
+FileSystem::HoldSectors(int count)
 {
-    opfile = NULL;
-    return 1;
+    return freeMap->Hold(count);
 }
+
 //----------------------------------------------------------------------
 // FileSystem::Remove
 // 	Delete a file from the file system.  This requires:
+//	    Find the directory it is in
 //	    Remove it from the directory
+//	    If it is a directory, delete everything in it
 //	    Delete the space for its header
 //	    Delete the space for its data blocks
+//	    Shrink the directory file, if the directory shrank
 //	    Write changes to directory, bitmap back to disk
 //
+//	All of this, however many files are deleted, is done as a single
+//	operation of the journal.
+//
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
-//	in the file system.
+//	in the file system, or is a directory that is not empty and
+//	"recursive" is not set.  The root directory cannot be deleted.
 //
-//	"name" -- the text name of the file to be removed
+//	"name" -- the path name of the file to be removed
+//	"recursive" -- may a directory that is not empty be removed?
 //----------------------------------------------------------------------
 
 bool
-FileSystem::Remove(char *name)
+FileSystem::Remove(char *name, bool recursive)
 { 
-    Directory *directory;
-    PersistentBitmap *freeMap;
-    FileHeader *fileHdr;
-    int sector;
+    char leaf[FileNameMaxLen + 1];
+    Directory *dir, *subDir;
+    OpenFile *dirFile, *subDirFile;
+    Inode *inode;
+    int parent, sector;
+    bool isDir;
     
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
-    if (sector == -1) {
-       delete directory;
-       return FALSE;			 // file not found 
+    parent = ResolveParent(name, leaf);
+    if (parent == -1 || leaf[0] == '\0')
+	return FALSE;			// no such directory, or the root
+    sector = Lookup(parent, leaf, &isDir);
+    if (sector == -1)
+	return FALSE;			// file not found 
+
+    journal->Begin();
+    inode = kernel->inodeTable->Acquire(sector);
+    if (isDir) {
+	subDir = FetchDirectory(sector, &subDirFile);
+	if (!recursive && !subDir->IsEmpty()) {
+	    ReleaseDirectory(subDir, subDirFile);
+	    kernel->inodeTable->Release(inode);
+	    journal->End();
+	    return FALSE;		// directory not empty
+	}
+	RemoveContents(subDir);
+	ReleaseDirectory(subDir, subDirFile);
+	ForgetDirectory(inode);
+	dentries->Purge(sector);
     }
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
-
-    freeMap = new PersistentBitmap(freeMapFile,NumSectors);
-
-    fileHdr->Deallocate(freeMap);  		// remove data blocks
+    inode->hdr->Deallocate(freeMap);  		// remove data blocks
     freeMap->Clear(sector);			// remove header block
-    directory->Remove(name);
+    freeMap->Unhold(inode->heldSectors);	// and any data not written
+    kernel->inodeTable->Remove(inode);
+    kernel->inodeTable->Release(inode);
+    super->numHeaders--;
+
+    dir = FetchDirectory(parent, &dirFile);
+    dir->Remove(leaf);
+    ASSERT(dirFile->Resize(freeMap, dir->FileSize()));
 
     freeMap->WriteBack(freeMapFile);		// flush to disk
-    directory->WriteBack(directoryFile);        // flush to disk
-    delete fileHdr;
-    delete directory;
-    delete freeMap;
+    dir->WriteBack(dirFile);			// flush to disk
+    dirFile->WriteBackHeader();
+    dentries->Enter(parent, leaf, -1, FALSE);
+    ReleaseDirectory(dir, dirFile);
+    journal->End();
     return TRUE;
 } 
 
 //----------------------------------------------------------------------
-// FileSystem::List
-// 	List all the files in the file system directory.
+// FileSystem::RemoveContents
+// 	Delete every file in a directory that is itself being deleted,
+//	and, for each sub-directory, everything in it.  The directory
+//	is emptied in memory only; there is no point writing it back,
+//	and it is de-allocated with its in-core header.
+//
+//	"dir" -- the directory to empty
 //----------------------------------------------------------------------
 
 void
-FileSystem::List()
+FileSystem::RemoveContents(Directory *dir)
+{
+    char name[FileNameMaxLen + 1];
+    Directory *subDir;
+    OpenFile *subDirFile;
+    Inode *inode;
+    int sector;
+    bool isDir;
+
+    while ((sector = dir->FirstEntry(name, &isDir)) != -1) {
+	inode = kernel->inodeTable->Acquire(sector);
+	if (isDir) {
+	    subDir = FetchDirectory(sector, &subDirFile);
+	    RemoveContents(subDir);
+	    ReleaseDirectory(subDir, subDirFile);
+	    ForgetDirectory(inode);
+	    dentries->Purge(sector);
+	}
+	inode->hdr->Deallocate(freeMap);
+	freeMap->Clear(sector);
+	freeMap->Unhold(inode->heldSectors);
+	kernel->inodeTable->Remove(inode);
+	kernel->inodeTable->Release(inode);
+	super->numHeaders--;
+	dir->Remove(name);
+    }
+}
+
+//----------------------------------------------------------------------
+// FileSystem::List
+// 	List all the files in a directory.  Return FALSE if there is
+//	no such directory.
+//
+//	"name" -- the path name of the directory
+//	"recursive" -- also list everything in each sub-directory
+//----------------------------------------------------------------------
+
+bool
+FileSystem::List(char *name, bool recursive)
 {
-    Directory *directory = new Directory(NumDirEntries);
+    Directory *dir;
+    OpenFile *dirFile;
+    bool isDir;
+    int sector;
 
-    directory->FetchFrom(directoryFile);
-    directory->List();
-    delete directory;
+    sector = Resolve(name, &isDir);
+    if (sector == -1 || !isDir)
+	return FALSE;
+    dir = FetchDirectory(sector, &dirFile);
+    dir->List(recursive, 0);
+    ReleaseDirectory(dir, dirFile);
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -342,28 +922,21 @@ FileSystem::List()
 void
 FileSystem::Print()
 {
-    FileHeader *bitHdr = new FileHeader;
-    FileHeader *dirHdr = new FileHeader;
-    PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile,NumSectors);
-    Directory *directory = new Directory(NumDirEntries);
+    Inode *bitInode = kernel->inodeTable->Acquire(FreeMapSector);
+    Inode *dirInode = kernel->inodeTable->Acquire(DirectorySector);
 
     printf("Bit map file header:\n");
-    bitHdr->FetchFrom(FreeMapSector);
-    bitHdr->Print();
+    bitInode->hdr->Print();
 
     printf("Directory file header:\n");
-    dirHdr->FetchFrom(DirectorySector);
-    dirHdr->Print();
+    dirInode->hdr->Print();
 
     freeMap->Print();
 
-    directory->FetchFrom(directoryFile);
     directory->Print();
 
-    delete bitHdr;
-    delete dirHdr;
-    delete freeMap;
-    delete directory;
+    kernel->inodeTable->Release(bitInode);
+    kernel->inodeTable->Release(dirInode);
 } 
 
 #endif // FILESYS_STUB
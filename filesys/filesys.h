@@ -18,10 +18,10 @@
 //	file system (in a file named "DISK"). 
 //
 //	In the "real" implementation, there are two key data structures used 
-//	in the file system.  There is a single "root" directory, listing
-//	all of the files in the file system; unlike UNIX, the baseline
-//	system does not provide a hierarchical directory structure.  
-//	In addition, there is a bitmap for allocating
+//	in the file system.  There is a "root" directory, listing
+//	the files at the top of the file system; as in UNIX, a file
+//	may itself be a directory, so that files are named by a path
+//	such as "/t0/bb/f3".  In addition, there is a bitmap for allocating
 //	disk sectors.  Both the root directory and the bitmap are themselves
 //	stored as files in the Nachos file system -- this causes an interesting
 //	bootstrap problem when the simulated disk is initialized. 
@@ -66,6 +66,15 @@ class FileSystem {
 };
 
 #else // FILESYS
+class Directory;
+class DentryCache;
+class PersistentBitmap;
+class Journal;
+class SuperBlock;
+class Bitmap;
+class Inode;
+template <class T> class List;
+
 class FileSystem {
   public:
     FileSystem(bool format);		// Initialize the file system.
@@ -80,25 +89,72 @@ class FileSystem {
     bool Create(char *name, int initialSize);  	
 					// Create a file (UNIX creat)
 
+    bool CreateDirectory(char *name);	// Create a directory (UNIX mkdir)
+
     OpenFile* Open(char *name); 	// Open a file (UNIX open)
 
-    bool Remove(char *name);  		// Delete a file (UNIX unlink)
+    bool Remove(char *name, bool recursive = FALSE);
+					// Delete a file (UNIX unlink), or 
+					// a directory and everything in it
+					// (UNIX rm -r)
 
-    void List();			// List all the files in the file system
+    bool List(char *name, bool recursive);
+					// List all the files in a directory
 
     void Print();			// List all the files and their contents
 
-	int Read(char *buffer, int size, int id);
-	int Write(char *buffer, int size, int id);
-	int Close(int id);
+    bool Resize(OpenFile *file, int newLength, int reserve = 0,
+			bool sparse = FALSE);
+					// Grow or shrink an open file,
+					// reserving sectors if it grows,
+					// or leaving a hole if "sparse"
+
+    bool FillHoles(OpenFile *file, int from, int to);
+					// Allocate sectors for the holes
+					// in part of a sparse file
+    bool HoldSectors(int count);	// Set aside free sectors for data
+					// kept in memory
 
-	OpenFile* opfile;
+    void Sync();			// Commit every operation so far to
+					// the journal (UNIX sync)
 
   private:
    OpenFile* freeMapFile;		// Bit map of free disk blocks,
 					// represented as a file
+   PersistentBitmap* freeMap;		// In-memory copy of the bit map
    OpenFile* directoryFile;		// "Root" directory -- list of 
 					// file names, represented as a file
+   Directory* directory;		// In-memory copy of the directory
+   DentryCache* dentries;		// Recent lookups of path components
+   Journal* journal;			// Log of operations not yet at home
+					// on disk
+   SuperBlock* super;			// In-memory copy of the superblock
+   ::List<Inode *>* residentDirs;	// Headers of the directories kept
+					// in memory, least recently used
+					// first
+
+   int Lookup(int dirSector, char *name, bool *isDir);
+					// Sector of "name" in a directory
+   int ResolveParent(char *path, char *leaf);
+					// Sector of the directory holding
+					// the last component of "path"
+   int Resolve(char *path, bool *isDir);
+					// Sector of the file named by "path"
+   Directory* FetchDirectory(int sector, OpenFile **file);
+					// Bring a directory into memory
+   void ReleaseDirectory(Directory *dir, OpenFile *file);
+					// Done with a fetched directory
+   void ForgetDirectory(Inode *inode);	// Stop keeping a deleted directory
+					// in memory
+   bool CreateFile(char *name, int initialSize, bool isDir);
+					// Create a file or a directory
+   void RemoveContents(Directory *dir);
+					// Delete everything in a directory
+   void Check();			// Make the bitmap agree with the
+					// files on disk
+   int CheckFile(int sector, bool isDir, Bitmap *inUse, int *headers);
+					// Mark the sectors of a file, and
+					// everything in it, in use
 };
 
 #endif // FILESYS
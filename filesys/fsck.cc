@@ -0,0 +1,698 @@
+// fsck.cc
+//	Routines to check a Nachos disk offline.  The disk is read
+//	straight from its UNIX file; nothing here uses the simulated
+//	disk, the block cache, or the file system, so that several host
+//	threads can read the disk at once.  The layout of the headers and
+//	directories on disk is described in filehdr.h and directory.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "debug.h"
+#include "fsck.h"
+#include "bitmap.h"
+#include "directory.h"
+#include "superblock.h"
+#include "journal.h"
+#include "sysdep.h"
+
+#define Unclaimed 	-1		// owner of a sector no file occupies
+
+//----------------------------------------------------------------------
+// CopyName
+//	Return a copy of a file name, to be kept after the original is
+//	gone.
+//----------------------------------------------------------------------
+
+static char *
+CopyName(const char *name)
+{
+    char *copy = new char[strlen(name) + 1];
+
+    strcpy(copy, name);
+    return copy;
+}
+
+//----------------------------------------------------------------------
+// ProblemCompare
+//	Order problems by sector, then by kind, so that the report comes
+//	out the same however the work was shared among the threads.
+//----------------------------------------------------------------------
+
+static int
+ProblemCompare(FsckProblem *x, FsckProblem *y)
+{
+    if (x->sector != y->sector)
+	return (x->sector < y->sector) ? -1 : 1;
+    return strcmp(x->kind, y->kind);
+}
+
+//----------------------------------------------------------------------
+// NewWorker, DeleteWorker
+//	Create the record of what a host thread finds, and get rid of it.
+//----------------------------------------------------------------------
+
+static FsckWorker *
+NewWorker(DiskChecker *checker)
+{
+    FsckWorker *worker = new FsckWorker;
+
+    worker->checker = checker;
+    worker->files = worker->directories = worker->headers = 0;
+    worker->problems = new SortedList<FsckProblem *>(ProblemCompare);
+    return worker;
+}
+
+static void
+DeleteWorker(FsckWorker *worker)
+{
+    delete worker->problems;
+    delete worker;
+}
+
+//----------------------------------------------------------------------
+// FsckThread
+//	What each host thread runs.
+//----------------------------------------------------------------------
+
+static void
+FsckThread(void *arg)
+{
+    FsckWorker *worker = (FsckWorker *) arg;
+
+    worker->checker->Work(worker);
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::DiskChecker
+// 	Open the UNIX file holding a Nachos disk, to check it.  Nothing
+//	is read until Check is called.
+//
+//	"diskName" -- the UNIX file, such as DISK_0
+//----------------------------------------------------------------------
+
+DiskChecker::DiskChecker(char *diskName)
+{
+    name = diskName;
+    fd = OpenForReadWrite(diskName, FALSE);
+    owner = NULL;
+    paths = NULL;
+    overlay = NULL;
+    pending = 0;
+    tasks = NULL;
+    numTasks = nextTask = 0;
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::~DiskChecker
+// 	Close the disk, and de-allocate what the check left behind.
+//----------------------------------------------------------------------
+
+DiskChecker::~DiskChecker()
+{
+    if (fd >= 0)
+	Close(fd);
+    if (owner != NULL) {
+	for (int i = 0; i < NumSectors; i++) {
+	    delete [] paths[i];
+	    delete [] overlay[i];
+	}
+	delete [] owner;
+	delete [] paths;
+	delete [] overlay;
+    }
+    for (int i = 0; i < numTasks; i++)
+	delete [] tasks[i].path;
+    delete [] tasks;
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::Check
+// 	Check the whole disk, and print the report.  Return TRUE if
+//	nothing is wrong with it.
+//
+//	The superblock, the bitmap and the root directory are checked
+//	first; then the subtrees of the root are walked by as many host
+//	threads as there are processors; then the sectors the files
+//	occupy are compared with the bitmap.
+//----------------------------------------------------------------------
+
+bool
+DiskChecker::Check()
+{
+    int label[MagicSize / sizeof(int)];
+    int *buf;
+    SuperBlock *super;
+    FsckWorker *ourWorker, **workers;
+    void **threads;
+    List<int> *mapSectors;
+    List<FsckTask *> *children;
+    SortedList<FsckProblem *> *problems;
+    unsigned *map;
+    int mapWords, numWorkers, files, directories, headers;
+    int used = 0, numFree = 0, errors = 0;
+    bool marked;
+
+    cout << "fsck disk " << name << "\n";
+    if (fd < 0) {
+	cout << "problem nodisk 0\nresult errors 1\n";
+	return FALSE;
+    }
+    ReadAt(fd, (char *) label, MagicSize, 0);
+    Lseek(fd, 0, 2);
+    if (label[0] != MagicNumber 
+		|| !DiskGeometryValid(label[1], label[2], label[3])
+		|| Tell(fd) != MagicSize + label[1] * label[2] * label[3]) {
+	cout << "problem badlabel 0\nresult errors 1\n";
+	return FALSE;
+    }
+    SetDiskGeometry(label[1], label[2], label[3]);	// take on its geometry
+    cout << "geometry " << SectorSize << " " << SectorsPerTrack << " "
+		<< NumTracks << "\n";
+
+    buf = new int[SectorSize / sizeof(int)];
+    super = new SuperBlock;
+    ReadAt(fd, (char *) buf, SectorSize, MagicSize);
+    super->Decode(buf);
+    delete [] buf;
+    if (!super->Matches() || super->journalStart <= DirectorySector
+		|| super->journalSectors < 2
+		|| super->journalStart > NumSectors - super->journalSectors) {
+	cout << "problem badsuper " << SuperBlockSector << "\nresult errors 1\n";
+	delete super;
+	return FALSE;
+    }
+    cout << "superblock clean " << super->clean << " free "
+		<< super->freeSectors << " headers " << super->numHeaders << "\n";
+
+    owner = new int[NumSectors];
+    paths = new char *[NumSectors];
+    overlay = new char *[NumSectors];
+    for (int i = 0; i < NumSectors; i++) {
+	owner[i] = Unclaimed;
+	paths[i] = overlay[i] = NULL;
+    }
+    ourWorker = NewWorker(this);
+
+    // the superblock and the journal belong to no file, but are in use
+    owner[SuperBlockSector] = SuperBlockSector;
+    paths[SuperBlockSector] = CopyName("(superblock)");
+    for (int i = 0; i < super->journalSectors; i++)
+	owner[super->journalStart + i] = super->journalStart;
+    paths[super->journalStart] = CopyName("(journal)");
+    if (!LoadJournal(super->journalStart, super->journalSectors))
+	Report(ourWorker, "badjournal", super->journalStart, Unclaimed, NULL);
+    cout << "journal pending " << pending << "\n";
+
+    // read in the bitmap
+    mapWords = divRoundUp(NumSectors, BitsInWord);
+    map = new unsigned[mapWords];
+    memset(map, 0, mapWords * sizeof(unsigned));
+    mapSectors = new List<int>;
+    if (CheckHeader(ourWorker, FreeMapSector, "(bitmap)", mapSectors)) {
+	char *data = new char[SectorSize];
+	int offset = 0, size = mapWords * sizeof(unsigned);
+
+	if (mapSectors->IsEmpty() && size <= MaxHeaderData) {
+	    ReadSector(FreeMapSector, data);	// kept in the header
+	    memcpy((char *) map, data + 4 * sizeof(int), size);
+	} else if ((int) mapSectors->NumInList() * SectorSize < size)
+	    Report(ourWorker, "badbitmap", FreeMapSector, Unclaimed, NULL);
+	while (!mapSectors->IsEmpty() && offset < size) {
+	    int sector = mapSectors->RemoveFront();
+
+	    if (sector == HoleSector)
+		memset(data, 0, SectorSize);
+	    else
+		ReadSector(sector, data);
+	    memcpy((char *) map + offset, data, min(SectorSize, size - offset));
+	    offset += SectorSize;
+	}
+	delete [] data;
+    }
+    delete mapSectors;
+
+    // walk the root, then share out its subtrees
+    children = new List<FsckTask *>;
+    CheckDirectory(ourWorker, DirectorySector, "/", children);
+    numTasks = children->NumInList();
+    tasks = new FsckTask[numTasks];
+    for (int i = 0; i < numTasks; i++) {
+	FsckTask *task = children->RemoveFront();
+
+	tasks[i] = *task;
+	delete task;
+    }
+    delete children;
+
+    numWorkers = min(NumHostProcessors(), numTasks);
+    DEBUG(dbgFile, "Checking " << numTasks << " subtrees with "
+		<< numWorkers << " threads");
+    workers = new FsckWorker *[numWorkers];
+    threads = new void *[numWorkers];
+    for (int i = 0; i < numWorkers; i++) {
+	workers[i] = NewWorker(this);
+	threads[i] = StartHostThread(FsckThread, workers[i]);
+    }
+    files = ourWorker->files;
+    directories = ourWorker->directories;
+    headers = ourWorker->headers;
+    for (int i = 0; i < numWorkers; i++) {
+	JoinHostThread(threads[i]);
+	files += workers[i]->files;
+	directories += workers[i]->directories;
+	headers += workers[i]->headers;
+	while (!workers[i]->problems->IsEmpty())
+	    ourWorker->problems->Insert(workers[i]->problems->RemoveFront());
+	DeleteWorker(workers[i]);
+    }
+    delete [] workers;
+    delete [] threads;
+
+    // compare what the files occupy with the bitmap
+    for (int i = 0; i < NumSectors; i++) {
+	marked = (map[i / BitsInWord] & (1U << (i % BitsInWord))) != 0;
+	if (owner[i] != Unclaimed)
+	    used++;
+	if (!marked)
+	    numFree++;
+	if (owner[i] != Unclaimed && !marked)
+	    Report(ourWorker, "unmarked", i, owner[i], NULL);
+	else if (owner[i] == Unclaimed && marked)
+	    Report(ourWorker, "leaked", i, Unclaimed, NULL);
+    }
+    delete [] map;
+    if (super->clean && (super->freeSectors != numFree
+		|| super->numHeaders != headers))
+	Report(ourWorker, "counts", SuperBlockSector, Unclaimed, NULL);
+    delete super;
+
+    cout << "files " << files << "\n";
+    cout << "directories " << directories << "\n";
+    cout << "sectors used " << used << " free " << numFree << "\n";
+    problems = ourWorker->problems;
+    while (!problems->IsEmpty()) {
+	FsckProblem *problem = problems->RemoveFront();
+
+	Print(problem);
+	errors++;
+	delete [] problem->path;
+	delete problem;
+    }
+    DeleteWorker(ourWorker);
+    if (errors == 0)
+	cout << "result ok\n";
+    else
+	cout << "result errors " << errors << "\n";
+    return errors == 0;
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::Work
+// 	Walk subtrees of the root, one at a time, until every one has
+//	been handed out.  Runs in each host thread.
+//
+//	"worker" -- where to keep what the thread finds
+//----------------------------------------------------------------------
+
+void
+DiskChecker::Work(FsckWorker *worker)
+{
+    int task;
+
+    while ((task = FetchAndAdd(&nextTask, 1)) < numTasks)
+	CheckFile(worker, tasks[task].sector, tasks[task].isDir,
+		tasks[task].path);
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::ReadSector
+// 	Read a sector of the disk, as it will be once the journal has
+//	been replayed.
+//
+//	"sector" -- the sector to read
+//	"data" -- where to put its contents
+//----------------------------------------------------------------------
+
+void
+DiskChecker::ReadSector(int sector, char *data)
+{
+    if (overlay[sector] != NULL)
+	memcpy(data, overlay[sector], SectorSize);
+    else
+	ReadAt(fd, data, SectorSize, MagicSize + sector * SectorSize);
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::LoadJournal
+// 	Find every committed transaction left in the journal, the same
+//	way Journal::Recover does, and remember the last contents each
+//	writes to each sector.  Return FALSE if the journal header is
+//	not valid.
+//
+//	"start" -- first sector of the journal region (its header)
+//	"numSectors" -- size of the region
+//----------------------------------------------------------------------
+
+bool
+DiskChecker::LoadJournal(int start, int numSectors)
+{
+    int ringSize = numSectors - 1;
+    int *desc = new int[SectorSize / sizeof(int)];
+    int *rec;
+    char *buf;
+    int head, sequence, count, size, descriptors, home;
+    bool complete;
+
+    ReadSector(start, (char *) desc);
+    head = desc[1];
+    sequence = desc[2];
+    if (desc[0] != JournalMagic || head < 0 || head >= ringSize) {
+	delete [] desc;
+	return FALSE;
+    }
+    for (;;) {
+	ReadSector(start + 1 + head, (char *) desc);
+	if (desc[0] != DescriptorMagic || desc[1] != sequence)
+	    break;			// end of the log
+	count = desc[2];
+	descriptors = divRoundUp(count, HomesPerDescriptor);
+	size = descriptors + count + 1;	// descriptors, blocks, commit
+	if (count <= 0 || size > ringSize)
+	    break;
+	buf = new char[size * SectorSize];
+	for (int i = 0; i < size; i++)
+	    ReadSector(start + 1 + (head + i) % ringSize, &buf[i * SectorSize]);
+
+	complete = TRUE;
+	for (int d = 0; d <= descriptors; d++) {
+	    rec = (int *) &buf[(d < descriptors ? d : size - 1) * SectorSize];
+	    if (rec[0] != (d < descriptors ? DescriptorMagic : CommitMagic)
+			|| rec[1] != sequence || rec[2] != count)
+		complete = FALSE;
+	}
+	for (int i = 0; complete && i < count; i++) {
+	    rec = (int *) &buf[(i / HomesPerDescriptor) * SectorSize];
+	    home = rec[3 + i % HomesPerDescriptor];
+	    if (home < 0 || home >= NumSectors)
+		continue;
+	    if (overlay[home] == NULL)
+		overlay[home] = new char[SectorSize];
+	    memcpy(overlay[home], &buf[(descriptors + i) * SectorSize],
+			SectorSize);
+	}
+	delete [] buf;
+	if (!complete)
+	    break;
+	head = (head + size) % ringSize;
+	sequence++;
+	pending++;
+    }
+    delete [] desc;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::Report
+// 	Note something wrong with the disk, to be printed once every
+//	thread is done.
+//
+//	"worker" -- the thread that found it
+//	"kind" -- what is wrong
+//	"sector" -- where
+//	"owner" -- header of the file owning the sector, or Unclaimed
+//	"path" -- name of another file involved, or NULL
+//----------------------------------------------------------------------
+
+void
+DiskChecker::Report(FsckWorker *worker, const char *kind, int sector,
+	int owner, char *path)
+{
+    FsckProblem *problem = new FsckProblem;
+
+    problem->kind = kind;
+    problem->sector = sector;
+    problem->owner = owner;
+    problem->path = (path == NULL) ? NULL : CopyName(path);
+    worker->problems->Insert(problem);
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::Claim
+// 	Claim a sector for a file.  If another file has already claimed
+//	it, report the sector as double-allocated, and return FALSE.
+//
+//	"worker" -- the thread doing the claiming
+//	"sector" -- the sector claimed
+//	"header" -- header of the file claiming it
+//	"path" -- name of the file claiming it
+//----------------------------------------------------------------------
+
+bool
+DiskChecker::Claim(FsckWorker *worker, int sector, int header, char *path)
+{
+    if (CompareAndSwap(&owner[sector], Unclaimed, header))
+	return TRUE;
+    Report(worker, "double", sector, owner[sector], path);
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::CheckExtents
+// 	Claim every sector of some extents of a file for the file.  A
+//	hole has no sectors to claim.  Return FALSE if an extent runs
+//	off the disk.
+//
+//	"worker" -- the thread doing the claiming
+//	"header", "path" -- the file's header and name
+//	"extents", "count" -- the extents
+//	"data" -- if not NULL, the sectors are appended to it (HoleSector
+//		for each block in a hole)
+//	"total" -- the number of sectors is added to it
+//----------------------------------------------------------------------
+
+bool
+DiskChecker::CheckExtents(FsckWorker *worker, int header, char *path,
+	Extent *extents, int count, List<int> *data, int *total)
+{
+    bool ok = TRUE;
+
+    for (int i = 0; i < count; i++) {
+	if (extents[i].start == HoleSector && extents[i].length > 0) {
+	    for (int j = 0; data != NULL && j < extents[i].length; j++)
+		data->Append(HoleSector);
+	    *total += extents[i].length;
+	    continue;
+	}
+	if (extents[i].start < 0 || extents[i].length <= 0
+		|| extents[i].start > NumSectors - extents[i].length) {
+	    ok = FALSE;
+	    continue;
+	}
+	for (int j = 0; j < extents[i].length; j++) {
+	    Claim(worker, extents[i].start + j, header, path);
+	    if (data != NULL)
+		data->Append(extents[i].start + j);
+	}
+	*total += extents[i].length;
+    }
+    if (!ok)
+	Report(worker, "range", header, header, NULL);
+    return ok;
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::CheckHeader
+// 	Claim the header of a file, its overflow extent sectors and its
+//	data sectors, and check that the header adds up.  A small file
+//	may have no data sectors, its data being kept in the header.
+//	Return FALSE if the header could not be claimed, or is not valid.
+//
+//	"worker" -- the thread doing the check
+//	"sector" -- the file's header
+//	"path" -- the file's name
+//	"data" -- if not NULL, the file's data sectors are appended to it,
+//		in order
+//----------------------------------------------------------------------
+
+bool
+DiskChecker::CheckHeader(FsckWorker *worker, int sector, char *path,
+	List<int> *data)
+{
+    int *buf, *chain;
+    int numBytes, numSectors, numExtents, next, count, total = 0;
+    bool ok;
+
+    if (!Claim(worker, sector, sector, path))
+	return FALSE;			// don't walk a file twice
+    paths[sector] = CopyName(path);
+    worker->headers++;
+
+    buf = new int[SectorSize / sizeof(int)];
+    ReadSector(sector, (char *) buf);
+    numBytes = buf[0];
+    numSectors = buf[1];
+    numExtents = buf[2];
+    next = buf[3];
+    if (numBytes < 0 || numSectors < 0 || numExtents < 0
+		|| numExtents > numSectors
+		|| numBytes > ((numSectors == 0) ? MaxHeaderData 
+				: (double) numSectors * SectorSize)) {
+	Report(worker, "badheader", sector, sector, NULL);
+	delete [] buf;
+	return FALSE;
+    }
+
+    count = min(numExtents, NumInlineExtents);
+    ok = CheckExtents(worker, sector, path, (Extent *) &buf[4], count,
+		data, &total);
+    numExtents -= count;
+    chain = new int[SectorSize / sizeof(int)];
+    while (numExtents > 0) {		// follow the overflow sectors
+	if (next < 0 || next >= NumSectors
+		|| !Claim(worker, next, sector, path)) {
+	    ok = FALSE;
+	    break;
+	}
+	ReadSector(next, (char *) chain);
+	count = chain[1];
+	if (count <= 0 || count > NumChainExtents || count > numExtents) {
+	    ok = FALSE;
+	    break;
+	}
+	if (!CheckExtents(worker, sector, path, (Extent *) &chain[2], count,
+		data, &total))
+	    ok = FALSE;
+	numExtents -= count;
+	next = chain[0];
+    }
+    delete [] chain;
+    delete [] buf;
+    if (!ok || total != numSectors) {
+	Report(worker, "badheader", sector, sector, NULL);
+	return FALSE;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::CheckDirectory
+// 	Check a directory, and every file in it.  Each entry in use must
+//	have a name and point at a sector on the disk.
+//
+//	"worker" -- the thread doing the check
+//	"sector" -- the directory's header
+//	"path" -- the directory's name
+//	"children" -- if not NULL, the files in the directory are
+//		appended to it, to be checked later, rather than checked
+//		now
+//----------------------------------------------------------------------
+
+void
+DiskChecker::CheckDirectory(FsckWorker *worker, int sector, char *path,
+	List<FsckTask *> *children)
+{
+    List<int> *chunks = new List<int>;
+    char *data = new char[SectorSize];
+    DirectoryEntry *entry = (DirectoryEntry *) data;
+    char *name;
+    bool bad = FALSE;
+
+    worker->directories++;
+    if (!CheckHeader(worker, sector, path, chunks)) {
+	delete chunks;
+	delete [] data;
+	return;
+    }
+    while (!chunks->IsEmpty()) {
+	int chunk = chunks->RemoveFront();
+
+	if (chunk == HoleSector)
+	    continue;			// no entries
+	ReadSector(chunk, data);
+	for (int i = 0; i < NumChunkEntries; i++) {
+	    if (!entry[i].inUse)
+		continue;
+	    if (entry[i].name[0] == '\0'
+		    || memchr(entry[i].name, '\0', FileNameMaxLen + 1) == NULL
+		    || entry[i].sector < 0 || entry[i].sector >= NumSectors) {
+		bad = TRUE;
+		continue;
+	    }
+	    name = new char[strlen(path) + FileNameMaxLen + 2];
+	    sprintf(name, "%s/%s", (strcmp(path, "/") == 0) ? "" : path,
+			entry[i].name);
+	    if (children != NULL) {
+		FsckTask *task = new FsckTask;
+
+		task->sector = entry[i].sector;
+		task->isDir = entry[i].isDir;
+		task->path = name;
+		children->Append(task);
+	    } else {
+		CheckFile(worker, entry[i].sector, entry[i].isDir, name);
+		delete [] name;
+	    }
+	}
+    }
+    if (bad)
+	Report(worker, "badentry", sector, sector, NULL);
+    delete chunks;
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::CheckFile
+// 	Check a file, and if it is a directory, everything under it.
+//
+//	"worker" -- the thread doing the check
+//	"sector" -- the file's header
+//	"isDir" -- is the file a directory?
+//	"path" -- the file's name
+//----------------------------------------------------------------------
+
+void
+DiskChecker::CheckFile(FsckWorker *worker, int sector, bool isDir, char *path)
+{
+    if (isDir)
+	CheckDirectory(worker, sector, path, NULL);
+    else {
+	worker->files++;
+	CheckHeader(worker, sector, path, NULL);
+    }
+}
+
+//----------------------------------------------------------------------
+// DiskChecker::Print
+// 	Print a problem as a line of the report: its kind and sector,
+//	then the names of the files involved, in alphabetical order.
+//
+//	"problem" -- the problem to print
+//----------------------------------------------------------------------
+
+void
+DiskChecker::Print(FsckProblem *problem)
+{
+    const char *first = NULL, *second = problem->path;
+
+    if (problem->owner != Unclaimed)
+	first = paths[problem->owner];
+    if (first == NULL) {
+	first = second;
+	second = NULL;
+    }
+    if (first != NULL && second != NULL && strcmp(first, second) > 0) {
+	const char *tmp = first;
+
+	first = second;
+	second = tmp;
+    }
+    cout << "problem " << problem->kind << " " << problem->sector;
+    if (first != NULL)
+	cout << " " << first;
+    if (second != NULL)
+	cout << " " << second;
+    cout << "\n";
+}
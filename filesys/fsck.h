@@ -0,0 +1,139 @@
+// fsck.h
+//	Data structures for checking the consistency of a Nachos disk
+//	offline, by reading the UNIX file holding the disk directly,
+//	without booting the file system on it.
+//
+//	The checker walks the directory tree from the root, and claims
+//	every sector each file occupies -- its header, its overflow
+//	extent sectors and its data -- for the file.  A sector claimed by
+//	two files is double-allocated.  Once the whole tree has been
+//	walked, the sectors claimed are compared with the bitmap of free
+//	sectors: a sector in use but marked free in the bitmap would be
+//	handed out again, and a sector marked in use that no file owns
+//	has leaked.
+//
+//	The sub-directories and files of the root are independent of one
+//	another, so they are handed out to several host threads, which
+//	walk them in parallel.  Each sector is claimed with an atomic
+//	compare-and-swap, so the threads share the table of owners
+//	without a lock; everything else a thread finds is kept to itself
+//	until all the threads are done.
+//
+//	If Nachos stopped without unmounting, committed transactions may
+//	still be waiting in the journal (cf. journal.h); the checker
+//	looks at the disk as it will be once they have been replayed.
+//
+//	The result is printed as a report, one fact per line, for
+//	scripts to read:
+//
+//	   fsck disk <name>
+//	   geometry <sector size> <sectors per track> <tracks>
+//	   superblock clean <0|1> free <sectors> headers <count>
+//	   journal pending <transactions>
+//	   files <count>
+//	   directories <count>
+//	   sectors used <count> free <count>
+//	   problem <kind> <sector> [<path> ...]
+//	   result ok | result errors <count>
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FSCK_H
+#define FSCK_H
+
+#include "list.h"
+#include "filehdr.h"
+
+// The following class defines something wrong found on the disk.
+
+class FsckProblem {
+  public:
+    const char *kind;			// What is wrong, as a single word
+    int sector;				// Where on disk
+    int owner;				// Header of the file that owns the
+					// sector, or -1
+    char *path;				// Name of the file that found the
+					// problem, if not the owner; or NULL
+};
+
+// The following class defines a subtree of the root directory, to be
+// walked by one of the host threads.
+
+class FsckTask {
+  public:
+    int sector;				// Header of the file
+    bool isDir;				// Is the file a directory?
+    char *path;				// Its full name
+};
+
+class DiskChecker;
+
+// The following class defines what one host thread has found.
+
+class FsckWorker {
+  public:
+    DiskChecker *checker;		// What the thread is checking
+    int files, directories;		// Counts of what it walked
+    int headers;			// File headers it claimed
+    SortedList<FsckProblem *> *problems;
+					// What it found wrong, by sector
+};
+
+// The following class defines the checker.
+
+class DiskChecker {
+  public:
+    DiskChecker(char *diskName);	// Open the disk "diskName"
+    ~DiskChecker();			// Close it
+
+    bool Check();			// Check the disk, and print the
+					// report; return TRUE if nothing
+					// is wrong
+
+    void Work(FsckWorker *worker);	// Body of each host thread: walk
+					// subtrees until none are left
+
+  private:
+    char *name;				// UNIX file holding the disk
+    int fd;				// ... open for reading
+    int *owner;				// For each sector, the header of the
+					// file that claimed it, or -1
+    char **paths;			// For each owner, the name of its
+					// file
+    char **overlay;			// For each sector, what the journal
+					// will write there, or NULL
+    int pending;			// Transactions left in the journal
+    FsckTask *tasks;			// Subtrees of the root
+    int numTasks;			// ... how many there are
+    int nextTask;			// ... the next to be handed out
+
+    void ReadSector(int sector, char *data);
+					// Read a sector, as it will be after
+					// the journal is replayed
+    bool LoadJournal(int start, int numSectors);
+					// Fill in "overlay" from the journal
+    void Report(FsckWorker *worker, const char *kind, int sector,
+		int owner, char *path);	// Note a problem
+    bool Claim(FsckWorker *worker, int sector, int header, char *path);
+					// Claim a sector for a file
+    bool CheckExtents(FsckWorker *worker, int header, char *path,
+		Extent *extents, int count, List<int> *data, int *total);
+					// Claim the sectors of some extents
+    bool CheckHeader(FsckWorker *worker, int sector, char *path,
+		List<int> *data);	// Claim everything a file occupies,
+					// listing its data sectors
+    void CheckDirectory(FsckWorker *worker, int sector, char *path,
+		List<FsckTask *> *children);
+					// Check a directory's entries, and
+					// its subtree unless "children" is
+					// given to collect them
+    void CheckFile(FsckWorker *worker, int sector, bool isDir, char *path);
+					// Check a file and its subtree
+    void Print(FsckProblem *problem);	// Print a line of the report
+};
+
+#endif // FSCK_H
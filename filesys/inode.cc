@@ -0,0 +1,214 @@
+// inode.cc
+//	Routines to share a single in-core copy of each file header
+//	among everyone using the file.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "debug.h"
+#include "inode.h"
+#include "directory.h"
+
+//----------------------------------------------------------------------
+// InodeKey, InodeHash
+//	Functions needed by the hash table indexing the in-core headers.
+//----------------------------------------------------------------------
+
+static int
+InodeKey(Inode *inode)
+{
+    return inode->sector;
+}
+
+static unsigned
+InodeHash(int sector)
+{
+    return (unsigned) sector;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::InodeTable
+// 	Initialize an empty table of in-core file headers.
+//----------------------------------------------------------------------
+
+InodeTable::InodeTable()
+{
+    index = new HashTable<int, Inode *>(InodeKey, InodeHash);
+    hits = misses = 0;
+    lock = new Lock("inode table lock");
+    ready = new Condition("inode ready");
+}
+
+//----------------------------------------------------------------------
+// InodeTable::~InodeTable
+// 	De-allocate the table.  Any file still open when Nachos halts
+//	is never going to be closed, so write back its header now.  Its
+//	delayed data must already have been given sectors and written
+//	(cf. FileSystem::~FileSystem).
+//----------------------------------------------------------------------
+
+InodeTable::~InodeTable()
+{
+    Inode *inode;
+
+    DEBUG(dbgFile, "Inode table: shared " << hits << ", read in " << misses);
+    while (!index->IsEmpty()) {
+	HashIterator<int, Inode *> iter(index);
+
+	inode = iter.Item();
+	ASSERT(inode->delayedLength == 0);
+	if (inode->dirty)
+	    inode->hdr->WriteBack(inode->sector);
+	index->Remove(inode->sector);
+	delete [] inode->delayed;
+	delete inode->dir;
+	delete inode->hdr;
+	delete inode;
+    }
+    delete index;
+    delete ready;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Acquire
+// 	Return the in-core copy of a file header, and count one more
+//	user of it.  The header is only read in from disk if no one else
+//	is using it already.  If someone else is still reading it in,
+//	wait for them.
+//
+//	"sector" -- the location on disk of the file header
+//----------------------------------------------------------------------
+
+Inode *
+InodeTable::Acquire(int sector)
+{
+    Inode *inode;
+
+    lock->Acquire();
+    if (index->Find(sector, &inode)) {
+	hits++;
+	inode->refCount++;
+	while (inode->loading)
+	    ready->Wait(lock);
+	lock->Release();
+	return inode;
+    }
+    misses++;
+    inode = new Inode;
+    inode->sector = sector;
+    inode->hdr = new FileHeader;
+    inode->refCount = 1;
+    inode->dirty = FALSE;
+    inode->removed = FALSE;
+    inode->loading = TRUE;
+    inode->delayed = NULL;
+    inode->delayedLength = 0;
+    inode->heldSectors = 0;
+    inode->dir = NULL;
+    index->Insert(inode);
+    lock->Release();
+
+    inode->hdr->FetchFrom(sector);	// may wait for the disk
+
+    lock->Acquire();
+    inode->loading = FALSE;
+    ready->Broadcast(lock);
+    lock->Release();
+    return inode;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Release
+// 	Count one less user of an in-core file header.  When the last
+//	user is done, write the header back if it has changed, and
+//	de-allocate it.
+//
+//	Writing the header back may wait for the disk, and someone may
+//	Acquire the header again in the meantime; if so, it is kept.
+//
+//	"inode" -- the in-core header, as returned by Acquire
+//----------------------------------------------------------------------
+
+void
+InodeTable::Release(Inode *inode)
+{
+    lock->Acquire();
+    ASSERT(inode->refCount > 0);
+    if (--inode->refCount > 0) {
+	lock->Release();
+	return;
+    }
+    if (!inode->removed && inode->dirty) {
+	DEBUG(dbgFile, "Writing back header in sector " << inode->sector);
+	inode->dirty = FALSE;
+	lock->Release();
+	inode->hdr->WriteBack(inode->sector);	// may wait for the disk
+	lock->Acquire();
+	if (inode->refCount > 0) {	// someone else has it now
+	    lock->Release();
+	    return;
+	}
+    }
+    if (!inode->removed)
+	index->Remove(inode->sector);
+    lock->Release();
+    delete [] inode->delayed;
+    delete inode->dir;
+    delete inode->hdr;
+    delete inode;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Remove
+// 	The file has been deleted, and its header sector freed, so the
+//	sector may soon hold the header of some other file.  Take the
+//	header out of the table, so that a later Acquire of the sector
+//	reads in the new header, and make sure this one is never
+//	written back, nor any data still waiting to be given sectors.
+//	The caller gives back the free sectors held for that data.
+//	Anyone still using it must still Release it.
+//
+//	"inode" -- the in-core header, as returned by Acquire
+//----------------------------------------------------------------------
+
+void
+InodeTable::Remove(Inode *inode)
+{
+    lock->Acquire();
+    ASSERT(!inode->removed);
+    index->Remove(inode->sector);
+    inode->removed = TRUE;
+    inode->dirty = FALSE;
+    inode->delayedLength = 0;
+    inode->heldSectors = 0;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// InodeTable::FindDelayed
+// 	Return the sector of the header of some file with data that has
+//	not been given sectors yet, or -1 if there is none.  Used to
+//	flush every file's data to disk (cf. FileSystem::Sync).
+//----------------------------------------------------------------------
+
+int
+InodeTable::FindDelayed()
+{
+    Inode *inode;
+    int sector = -1;
+
+    lock->Acquire();
+    HashIterator<int, Inode *> iter(index);
+    for (; !iter.IsDone(); iter.Next()) {
+	inode = iter.Item();
+	if (!inode->loading && inode->delayedLength > 0) {
+	    sector = inode->sector;
+	    break;
+	}
+    }
+    lock->Release();
+    return sector;
+}
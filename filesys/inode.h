@@ -0,0 +1,96 @@
+// inode.h
+//	Data structures for the table of in-core file headers.
+//
+//	A file header (the UNIX "i-node") is brought into memory when the
+//	file is opened.  If the same file is open several times at once,
+//	or is looked at by the file system while it is open, all of them
+//	share a single in-core copy of the header, so that it is read
+//	from disk only once, and so that a change made through one of
+//	them (such as growing the file) is seen by all the others.
+//
+//	Each in-core header is reference counted.  A change to the header
+//	only marks it dirty; the header is written back to disk once,
+//	when the last reference to it is released.
+//
+//	Data appended to a file is not given sectors right away; it is
+//	kept with the in-core header, so that every open of the file
+//	sees it, until there is enough of it to allocate in one run, or
+//	the file is last closed (cf. openfile.cc).
+//
+//	The contents of a directory, once read in, are kept with its
+//	in-core header too, so that every user of the directory shares
+//	them (cf. FileSystem::FetchDirectory).
+//
+//	A header is entered in the table before it is read in, so that
+//	a second thread opening the same file while the first waits for
+//	the disk shares it too, waiting until it has been read.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef INODE_H
+#define INODE_H
+
+#include "hash.h"
+#include "synch.h"
+#include "filehdr.h"
+
+class Directory;
+
+// The following class defines an in-core file header.
+//
+// Internal data structures kept public so that the file system can
+// access them directly.
+
+class Inode {
+  public:
+    int sector;				// Where the header lives on disk
+    FileHeader *hdr;			// The header itself
+    int refCount;			// How many users it has
+    bool dirty;				// Changed since read from disk?
+    bool removed;			// File deleted?  Then the header
+					// is never written back
+    bool loading;			// Still being read in from disk?
+    char *delayed;			// Data written past the end of the
+					// file, without sectors yet; or NULL
+    int delayedLength;			// ... how many bytes of it
+    int heldSectors;			// ... and how many free sectors are
+					// held to give it (cf. pbitmap.h)
+    Directory *dir;			// In-core copy of the contents, if
+					// the file is a directory that has
+					// been read in; or NULL
+};
+
+// The following class defines the table of in-core file headers,
+// indexed by the sector of each header.
+
+class InodeTable {
+  public:
+    InodeTable();			// Initialize an empty table
+    ~InodeTable();			// De-allocate the table, writing
+					// back headers still in use
+
+    Inode *Acquire(int sector);		// Get the in-core copy of the
+					// header in "sector", reading it
+					// in if no one else is using it
+    void Release(Inode *inode);		// Done with the header; the last
+					// user writes it back if dirty
+    void Remove(Inode *inode);		// The file has been deleted; forget
+					// the header, and don't write it
+					// back
+    int FindDelayed();			// Header of a file with delayed
+					// data, or -1 if there is none
+
+  private:
+    HashTable<int, Inode *> *index;	// Header sector -> in-core header
+    int hits, misses;			// How often a header was shared
+    Lock *lock;				// Only one thread may touch the
+					// table at a time
+    Condition *ready;			// Signalled when a header has been
+					// read in
+};
+
+#endif // INODE_H
@@ -0,0 +1,481 @@
+// journal.cc
+//	Routines to log file system operations to a write-ahead journal,
+//	commit them, and replay them after Nachos stops unexpectedly.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "debug.h"
+#include "journal.h"
+#include "blockcache.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// BlockKey, BlockHash
+//	Functions needed by the hash table indexing the logged blocks.
+//----------------------------------------------------------------------
+
+static int
+BlockKey(JournalBlock *block)
+{
+    return block->sector;
+}
+
+static unsigned
+BlockHash(int sector)
+{
+    return (unsigned) sector;
+}
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Initialize a journal with no transaction running.  Format or
+//	Recover must be called before it is used.
+//
+//	"start" -- first sector of the journal region on disk
+//	"numSectors" -- size of the region, header included
+//	"opSectors" -- the most sectors a single operation may write
+//----------------------------------------------------------------------
+
+Journal::Journal(int start, int numSectors, int opSectors)
+{
+    ASSERT(numSectors >= MinJournalSectors);
+    this->start = start;
+    ringSize = numSectors - 1;
+    tail = head = used = 0;
+    tailSequence = sequence = 1;
+    this->opSectors = opSectors;
+    ASSERT(RecordSize(opSectors) <= ringSize);
+    nesting = 0;
+    operators = new List<Thread *>;
+    committing = FALSE;
+    lastCommit = kernel->stats->totalTicks;
+    index = new HashTable<int, JournalBlock *>(BlockKey, BlockHash);
+    blocks = new List<JournalBlock *>;
+    lock = new Lock("journal lock");
+    idle = new Condition("journal idle");
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    ASSERT(nesting == 0 && blocks->IsEmpty());
+    delete operators;
+    delete index;
+    delete blocks;
+    delete idle;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Write an empty journal to disk.  The log itself is cleared too,
+//	so that nothing left on the disk from before it was formatted
+//	looks like a transaction to Recover.
+//----------------------------------------------------------------------
+
+void
+Journal::Format()
+{
+    char *buf = new char[ringSize * SectorSize];
+
+    DEBUG(dbgFile, "Formatting journal of " << ringSize << " sectors at sector " << start);
+    memset(buf, 0, ringSize * SectorSize);
+    Transfer(0, ringSize, buf, TRUE);
+    delete [] buf;
+    tail = head = used = 0;
+    tailSequence = sequence = 1;
+    WriteHeader();
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	Replay the journal, when the file system is mounted.  Starting
+//	at the oldest record not checkpointed, copy the sectors of each
+//	transaction to their homes, as long as the whole record, down to
+//	its commit block, is there.  The first record that is missing or
+//	incomplete ends the log: the operations in it never finished
+//	committing, so they never happened.
+//
+//	The journal is then checkpointed, leaving it empty.  The block
+//	cache must not be logging yet.
+//----------------------------------------------------------------------
+
+void
+Journal::Recover()
+{
+    int *desc = new int[SectorSize / sizeof(int)];
+    int *rec;
+    char *buf;
+    int count, size, descriptors, replayed = 0;
+    bool complete;
+
+    kernel->synchDisk->ReadSector(start, (char *) desc);
+    ASSERT(desc[0] == JournalMagic);
+    tail = head = desc[1];
+    tailSequence = sequence = desc[2];
+    ASSERT(tail >= 0 && tail < ringSize);
+
+    for (;;) {
+	Transfer(head, 1, (char *) desc, FALSE);
+	if (desc[0] != DescriptorMagic || desc[1] != sequence)
+	    break;			// end of the log
+	count = desc[2];
+	if (count <= 0 || RecordSize(count) > ringSize)
+	    break;
+	size = RecordSize(count);
+	descriptors = divRoundUp(count, HomesPerDescriptor);
+	buf = new char[size * SectorSize];
+	Transfer(head, size, buf, FALSE);
+
+	complete = TRUE;		// every descriptor, and the commit
+	for (int d = 0; d <= descriptors; d++) {	// block, is there
+	    rec = (int *) &buf[(d < descriptors ? d : size - 1) * SectorSize];
+	    if (rec[0] != (d < descriptors ? DescriptorMagic : CommitMagic)
+			|| rec[1] != sequence || rec[2] != count)
+		complete = FALSE;
+	}
+	if (complete) {
+	    DEBUG(dbgFile, "Replaying transaction " << sequence << ", " << count << " sectors");
+	    for (int i = 0; i < count; i++) {
+		rec = (int *) &buf[(i / HomesPerDescriptor) * SectorSize];
+		kernel->blockCache->WriteSector(rec[3 + i % HomesPerDescriptor],
+			&buf[(descriptors + i) * SectorSize]);
+	    }
+	}
+	delete [] buf;
+	if (!complete)
+	    break;
+	head = (head + size) % ringSize;
+	used += size;
+	sequence++;
+	replayed++;
+    }
+    delete [] desc;
+    DEBUG(dbgFile, "Journal: replayed " << replayed << " transactions");
+    Checkpoint();
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start a file system operation.  Everything the current thread
+//	writes through the block cache until the matching End is logged.
+//	A thread may not start an operation inside another.
+//
+//	The operation may add up to opSectors blocks to the running
+//	transaction, and so may each of those already in progress.  If
+//	the log could not then hold the transaction as one record, wait
+//	for them to finish, and commit it before starting.
+//----------------------------------------------------------------------
+
+void
+Journal::Begin()
+{
+    lock->Acquire();
+    ASSERT(!operators->IsInList(kernel->currentThread));
+    while (RecordSize(blocks->NumInList() + (nesting + 1) * opSectors)
+		> ringSize) {
+	if (nesting == 0) {
+	    CommitRecord();
+	    lastCommit = kernel->stats->totalTicks;
+	} else
+	    idle->Wait(lock);
+    }
+    nesting++;
+    operators->Append(kernel->currentThread);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	Finish a file system operation.  When no other operation is in
+//	progress, commit the running transaction if it has grown to half
+//	the size of the log, or if it has been running for CommitInterval
+//	ticks; otherwise, leave it running, so that the next few
+//	operations can share its commit.
+//----------------------------------------------------------------------
+
+void
+Journal::End()
+{
+    lock->Acquire();
+    ASSERT(nesting > 0);
+    ASSERT(RecordSize(blocks->NumInList()) <= ringSize);
+    operators->Remove(kernel->currentThread);
+    kernel->stats->numJournalOps++;
+    if (--nesting == 0 && !blocks->IsEmpty() &&
+		(RecordSize(blocks->NumInList()) >= ringSize / 2 ||
+		kernel->stats->totalTicks - lastCommit >= CommitInterval)) {
+	CommitRecord();
+	lastCommit = kernel->stats->totalTicks;
+    }
+    idle->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::IsLogging
+// 	Return TRUE if a write to a sector must go to the journal rather
+//	than to the disk: if the current thread is running an operation,
+//	and also otherwise if the running transaction already holds the
+//	sector, so that its copy stays up to date.  Committed sectors on
+//	their way home are not logged again.
+//
+//	"sectorNumber" -- the sector being written
+//----------------------------------------------------------------------
+
+bool
+Journal::IsLogging(int sectorNumber)
+{
+    JournalBlock *block;
+
+    if (committing)
+	return FALSE;
+    return operators->IsInList(kernel->currentThread)
+		|| index->Find(sectorNumber, &block);
+}
+
+//----------------------------------------------------------------------
+// Journal::Log
+// 	Add a sector written to the running transaction, or, if it has
+//	already logged the sector, update its contents.  Called by the
+//	block cache, with the cache locked, so this must not wait for
+//	anything.
+//
+//	If the sector was committed by an earlier transaction, but the
+//	cache has not yet sent it home, the cache's dirty copy is about to
+//	be overwritten.  The journal keeps it instead, so that a 
+//	checkpoint can send it home before the journal forgets the
+//	earlier transaction.
+//
+//	"sectorNumber" -- home of the sector on disk
+//	"data" -- its new contents
+//	"committed" -- its committed contents, if not on disk; else NULL
+//----------------------------------------------------------------------
+
+void
+Journal::Log(int sectorNumber, char *data, char *committed)
+{
+    JournalBlock *block;
+
+    if (!index->Find(sectorNumber, &block)) {
+	block = new JournalBlock;
+	block->sector = sectorNumber;
+	block->data = new char[SectorSize];
+	block->committed = NULL;
+	index->Insert(block);
+	blocks->Append(block);
+    }
+    if (committed != NULL) {
+	if (block->committed == NULL)
+	    block->committed = new char[SectorSize];
+	bcopy(committed, block->committed, SectorSize);
+    }
+    bcopy(data, block->data, SectorSize);
+}
+
+//----------------------------------------------------------------------
+// Journal::Find
+// 	If a sector has been logged but not yet let go home, the copy on
+//	disk is out of date.  Return TRUE, and copy its contents out of
+//	the journal, if so.  Called by the block cache on a miss.
+//
+//	"sectorNumber" -- the sector read from disk
+//	"data" -- holds what was read; overwritten if the journal has
+//		newer contents
+//----------------------------------------------------------------------
+
+bool
+Journal::Find(int sectorNumber, char *data)
+{
+    JournalBlock *block;
+
+    if (!index->Find(sectorNumber, &block))
+	return FALSE;
+    bcopy(block->data, data, SectorSize);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Commit the running transaction now, whatever its size.  No
+//	operation may be in progress.
+//----------------------------------------------------------------------
+
+void
+Journal::Commit()
+{
+    lock->Acquire();
+    ASSERT(nesting == 0);
+    if (!blocks->IsEmpty())
+	CommitRecord();
+    lastCommit = kernel->stats->totalTicks;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Empty the journal.  First make sure every committed sector is at
+//	home on disk: flush the block cache, and write out the committed
+//	contents the journal kept of sectors the running transaction has
+//	logged again since.  Then record in the header that the log now
+//	starts at the head.
+//----------------------------------------------------------------------
+
+void
+Journal::Checkpoint()
+{
+    ListIterator<JournalBlock *> iter(blocks);
+    JournalBlock *block;
+
+    DEBUG(dbgFile, "Checkpointing journal, " << used << " sectors in use");
+    kernel->blockCache->Flush();
+    for (; !iter.IsDone(); iter.Next()) {
+	block = iter.Item();
+	if (block->committed != NULL) {
+	    kernel->synchDisk->WriteSector(block->sector, block->committed);
+	    delete [] block->committed;
+	    block->committed = NULL;
+	}
+    }
+    tail = head;
+    tailSequence = sequence;
+    used = 0;
+    WriteHeader();
+}
+
+//----------------------------------------------------------------------
+// Journal::RecordSize
+// 	Return the number of sectors needed in the log for a transaction
+//	of "count" blocks: its descriptors, the blocks themselves, and
+//	the commit block.
+//----------------------------------------------------------------------
+
+int
+Journal::RecordSize(int count)
+{
+    return divRoundUp(count, HomesPerDescriptor) + count + 1;
+}
+
+//----------------------------------------------------------------------
+// Journal::CommitRecord
+// 	Write the running transaction to the log, as one record,
+//	checkpointing first if there is not room for it.  The descriptors and blocks are written first, and only then
+//	the commit block, so that a commit block is never on disk without
+//	the rest of its record.
+//
+//	Once committed, each block is written to the block cache, without
+//	being logged, so that the cache sends it home in the usual way,
+//	and dropped from the transaction.
+//
+//	Begin never lets a transaction outgrow the log, so that it is
+//	always replayed, or not, as a whole.
+//----------------------------------------------------------------------
+
+void
+Journal::CommitRecord()
+{
+    ListIterator<JournalBlock *> iter(blocks);
+    JournalBlock *block;
+    int count = blocks->NumInList();
+    int descriptors, size, i;
+    char *buf;
+    int *rec;
+
+    ASSERT(nesting == 0 && count > 0 && RecordSize(count) <= ringSize);
+    size = RecordSize(count);
+    descriptors = divRoundUp(count, HomesPerDescriptor);
+    if (size > ringSize - used)
+	Checkpoint();
+
+    buf = new char[size * SectorSize];
+    memset(buf, 0, size * SectorSize);
+    for (int d = 0; d <= descriptors; d++) {
+	rec = (int *) &buf[(d < descriptors ? d : size - 1) * SectorSize];
+	rec[0] = (d < descriptors ? DescriptorMagic : CommitMagic);
+	rec[1] = sequence;
+	rec[2] = count;
+    }
+    for (i = 0; i < count; i++, iter.Next()) {
+	block = iter.Item();
+	rec = (int *) &buf[(i / HomesPerDescriptor) * SectorSize];
+	rec[3 + i % HomesPerDescriptor] = block->sector;
+	bcopy(block->data, &buf[(descriptors + i) * SectorSize], SectorSize);
+    }
+    DEBUG(dbgFile, "Committing transaction " << sequence << ", " << count << " sectors");
+    Transfer(head, size - 1, buf, TRUE);
+    Transfer((head + size - 1) % ringSize, 1, &buf[(size - 1) * SectorSize], TRUE);
+    delete [] buf;
+    head = (head + size) % ringSize;
+    used += size;
+    sequence++;
+    kernel->stats->numJournalCommits++;
+    kernel->stats->numJournalSectors += size;
+
+    committing = TRUE;
+    for (i = 0; i < count; i++) {
+	block = blocks->Front();
+	kernel->blockCache->WriteSector(block->sector, block->data);
+	blocks->RemoveFront();		// the cache has it now
+	index->Remove(block->sector);
+	delete [] block->data;
+	delete [] block->committed;
+	delete block;
+    }
+    committing = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteHeader
+// 	Write the header sector, recording where the log starts.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteHeader()
+{
+    int *buf = new int[SectorSize / sizeof(int)];
+
+    memset(buf, 0, SectorSize);
+    buf[0] = JournalMagic;
+    buf[1] = tail;
+    buf[2] = tailSequence;
+    kernel->synchDisk->WriteSector(start, (char *) buf);
+    delete [] buf;
+}
+
+//----------------------------------------------------------------------
+// Journal::Transfer
+// 	Read or write "count" consecutive sectors of the log, starting
+//	at "position", straight to or from the disk.  The journal region
+//	never goes through the block cache.  A run that reaches the end
+//	of the log wraps around to its start.
+//
+//	"position" -- where in the log to start
+//	"count" -- number of sectors to transfer
+//	"data" -- buffer holding "count" sectors
+//	"writing" -- write to the disk, or read from it?
+//----------------------------------------------------------------------
+
+void
+Journal::Transfer(int position, int count, char *data, bool writing)
+{
+    int piece;
+
+    ASSERT(count <= ringSize);
+    while (count > 0) {
+	piece = min(count, ringSize - position);
+	if (writing)
+	    kernel->synchDisk->WriteSectors(start + 1 + position, piece, data);
+	else
+	    kernel->synchDisk->ReadSectors(start + 1 + position, piece, data);
+	data += piece * SectorSize;
+	position = (position + piece) % ringSize;
+	count -= piece;
+    }
+}
@@ -0,0 +1,162 @@
+// journal.h
+//	Data structures for a write-ahead journal of file system metadata.
+//
+//	An operation such as Create changes several sectors at once: the
+//	bitmap of free sectors, the directory, and the new file header.
+//	If Nachos stops after some of them reach the disk but not the
+//	others, the file system is left inconsistent -- for instance, a
+//	sector marked in use that no file owns, or a directory entry
+//	pointing at a header that was never written.
+//
+//	Instead, every sector an operation writes goes first to a
+//	journal, a fixed region of the disk used as a circular log.  An
+//	operation is bracketed by Begin and End; the block cache hands
+//	each sector the thread running the operation writes meanwhile to
+//	the journal, which keeps a copy of it in memory, and does not let
+//	the cache write it to its home on disk.
+//
+//	The operations logged since the last commit form a single
+//	transaction, so that many small operations touching the same
+//	few sectors (say, creating a lot of files in one directory) log
+//	each sector only once.  The transaction is committed -- written
+//	to the journal as a record of the sectors, followed by a commit
+//	block -- when it gets large, when enough time has passed since
+//	the last commit, or when the file system is shut down.  Only
+//	then are its sectors allowed to go home, through the cache.
+//
+//	A transaction is always committed as a single record, so it must
+//	never outgrow the log.  Each operation may write up to a fixed
+//	number of sectors, and an operation only starts once the running
+//	transaction has room for it, as well as for every operation
+//	already in progress.
+//
+//	When the journal fills up, it is checkpointed: the cache is
+//	flushed, so that every committed sector is at home, and the
+//	journal is emptied.  When the file system is mounted, every
+//	transaction whose commit block made it to the journal is
+//	replayed, and any transaction that did not is ignored, so that
+//	each operation happens either entirely or not at all.
+//
+//	On disk, the first sector of the journal region is a header,
+//	giving where the oldest record not yet checkpointed starts; the
+//	rest is the circular log.  A transaction's record is:
+//
+//	   one or more descriptor sectors, listing where each sector of
+//	    the transaction belongs
+//	   the contents of those sectors
+//	   a commit sector
+//
+//	Each of these carries the transaction's sequence number, so a
+//	stale record left behind by an earlier trip around the log is
+//	never mistaken for a new one.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "hash.h"
+#include "list.h"
+#include "synch.h"
+
+const int MinJournalSectors = 16;	// smallest journal region, in
+					// sectors, including the header
+const int CommitInterval = 1000000;	// commit at least this often, in
+					// ticks, while operations go on
+
+// Markers identifying each kind of sector in the journal region
+const int JournalMagic = 0x4e4a4844;	// "NJHD", the header
+const int DescriptorMagic = 0x4e4a4453;	// "NJDS", a descriptor
+const int CommitMagic = 0x4e4a434d;	// "NJCM", a commit block
+
+// Number of home sectors listed by one descriptor sector, after its
+// magic number, sequence number and block count
+#define HomesPerDescriptor 	((int) (SectorSize / sizeof(int)) - 3)
+
+// The following class defines a sector logged by the running
+// transaction, with its latest contents.
+
+class JournalBlock {
+  public:
+    int sector;				// Home of the sector on disk
+    char *data;				// What the transaction wrote there
+    char *committed;			// What an earlier transaction
+					// committed there, if that has not
+					// reached the disk yet; else NULL
+};
+
+// The following class defines the journal.
+
+class Journal {
+  public:
+    Journal(int start, int numSectors, int opSectors);
+					// The journal occupies sectors
+					// "start" to "start"+"numSectors"-1;
+					// no operation writes more than
+					// "opSectors" sectors
+    ~Journal();				// De-allocate the journal; the
+					// running transaction must have
+					// been committed
+
+    void Format();			// Write an empty journal to disk
+    void Recover();			// Replay every committed transaction
+					// left in the journal, then empty it
+
+    void Begin();			// Start a file system operation
+    void End();				// Finish one; commit the running
+					// transaction if it is time to
+    bool IsLogging(int sectorNumber);	// Must a write to the sector be
+					// logged?
+
+    void Log(int sectorNumber, char *data, char *committed);
+					// Add a sector written to the
+					// transaction
+    bool Find(int sectorNumber, char *data);
+					// If the running transaction has
+					// logged the sector, copy out its
+					// contents
+
+    void Commit();			// Commit the running transaction
+    void Checkpoint();			// Send every committed sector home,
+					// and empty the journal
+
+  private:
+    int start;				// First sector of the region (the
+					// header)
+    int ringSize;			// Number of sectors in the log
+    int tail;				// Log position of the oldest record
+					// not yet checkpointed
+    int head;				// Log position of the next record
+    int used;				// Sectors between tail and head
+    int tailSequence;			// Sequence number of the record at
+					// "tail"
+    int sequence;			// Sequence number of the running
+					// transaction
+    int opSectors;			// Most sectors one operation writes
+    int nesting;			// Operations in progress
+    List<Thread *> *operators;		// Threads running them
+    bool committing;			// Letting committed sectors go home?
+    int lastCommit;			// When the last commit happened
+    HashTable<int, JournalBlock *> *index;
+					// Sector -> its block in the running
+					// transaction
+    List<JournalBlock *> *blocks;	// Blocks in the order first logged
+    Lock *lock;				// Held by a commit, so that no new
+					// operation starts meanwhile
+    Condition *idle;			// Signalled when an operation ends
+
+    int RecordSize(int count);		// Sectors in the record of a
+					// transaction of "count" blocks
+    void CommitRecord();		// Write the running transaction out
+					// as one record, and let it go home
+    void WriteHeader();			// Write the header sector
+    void Transfer(int position, int count, char *data, bool writing);
+					// Read/write sectors of the log,
+					// wrapping around its end
+};
+
+#endif // JOURNAL_H
@@ -5,7 +5,8 @@
 //	the OpenFile data structure).
 //
 //	Also as in UNIX, for convenience, we keep the file header in
-//	memory while the file is open.
+//	memory while the file is open.  Everyone with the file open
+//	shares the same in-core copy of the header (cf. inode.h).
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -15,8 +16,27 @@
 #include "copyright.h"
 #include "main.h"
 #include "filehdr.h"
+#include "inode.h"
 #include "openfile.h"
-#include "synchdisk.h"
+#include "blockcache.h"
+#include "pbitmap.h"
+
+// Bounds on the read-ahead window, in sectors.  The window starts out
+// small when a file is first read sequentially, and doubles with
+// every further sequential read up to a track's worth of sectors.
+static const int MinReadAhead = 4;
+#define MaxReadAhead SectorsPerTrack
+
+// Most sectors reserved past the end of a file when it grows.  A file
+// reserves as many sectors as it already has, up to a track's worth,
+// so that a file written a little at a time still ends up in long
+// runs, and no more than half of a small file's sectors go unused.
+#define MaxGrowReserve SectorsPerTrack
+
+// Most data kept in memory past the end of a file before it is given
+// sectors.  A track's worth is allocated as a single run, and
+// written to disk as a single request.
+#define MaxDelayed (SectorsPerTrack * SectorSize)
 
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
@@ -28,19 +48,34 @@
 
 OpenFile::OpenFile(int sector)
 { 
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
+    inode = kernel->inodeTable->Acquire(sector);
+    hdr = inode->hdr;
     seekPosition = 0;
+    lastSectorRead = -1;		// so that reading from the start
+					// of the file counts as sequential
+    readAheadWindow = 0;
+    readAheadLimit = 0;
+    staging = new char[SectorSize];
+    memset(staging, 0, SectorSize);	// dummy operation to keep valgrind happy
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	If this was the last open of the file, data still waiting for
+//	sectors is written out, any sectors reserved while growing are
+//	given back, and the header is written back if it has changed.
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
-    delete hdr;
+    if (inode->refCount == 1 && !inode->removed) {
+	Flush();
+	if (hdr->Capacity() - hdr->FileLength() >= SectorSize)
+	    kernel->fileSystem->Resize(this, hdr->FileLength());
+    }
+    kernel->inodeTable->Release(inode);
+    delete [] staging;
 }
 
 //----------------------------------------------------------------------
@@ -96,14 +131,40 @@ OpenFile::Write(char *into, int numBytes)
 //	boundary; however the disk only knows how to read/write a whole disk
 //	sector at a time.  Thus:
 //
+//	Sectors wholly covered by the request are transferred directly
+//	between the disk (or block cache) and the caller's buffer.  A
+//	sector only partly covered, at either end, goes through the
+//	file's staging buffer:
+//
 //	For ReadAt:
-//	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	   We read in the whole sector, but we only copy the part we are
+//	   interested in.
 //	For WriteAt:
-//	   We must first read in any sectors that will be partially written,
-//	   so that we don't overwrite the unmodified portion.  We then copy
-//	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   We must first read in the sector, so that we don't overwrite the
+//	   unmodified portion.  We then copy in the data that will be 
+//	   modified, and write the sector back.
+//
+//	Blocks of a sparse file that have never been written have no
+//	sectors (cf. filehdr.h); they read as zeros, without going to
+//	the disk, and are given sectors when they are first written.
+//
+//	A small file has no sectors of its own; its data is kept in the
+//	header (cf. filehdr.h), so it is read straight out of the in-core
+//	header, and written by writing back the header.
+//
+//	A write past the end of the file makes the file longer.  Small
+//	writes there are not given sectors right away: the data is kept
+//	in memory, shared by every open of the file, until a track's
+//	worth has built up or the file is last closed, and is then
+//	allocated as one run, with one change to the bitmap.  A file
+//	written a few bytes at a time thus ends up as contiguous as one
+//	written all at once.  A larger write is given sectors at once;
+//	if the disk is full, as much is written as fits.
+//
+//	Sectors of the file that are also consecutive on disk are 
+//	transferred as a single run, rather than one sector at a time.
+//	After a read, the sectors that follow it are read ahead if the
+//	file is being read sequentially.
 //
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
@@ -115,9 +176,9 @@ OpenFile::Write(char *into, int numBytes)
 int
 OpenFile::ReadAt(char *into, int numBytes, int position)
 {
-    int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    char *buf;
+    int fileLength = Length();
+    int onDisk = hdr->FileLength();
+    int end, pos, offset, amount, count, sector;
 
     if ((numBytes <= 0) || (position >= fileLength))
     	return 0; 				// check request
@@ -125,66 +186,432 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
 	numBytes = fileLength - position;
     DEBUG(dbgFile, "Reading " << numBytes << " bytes at " << position << " from file of length " << fileLength);
 
-    firstSector = divRoundDown(position, SectorSize);
-    lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
-
-    // read in all the full and partial sectors that we need
-    buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)	
-        kernel->synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
+    end = position + numBytes;
+    if (end > onDisk) {			// the end has no sectors yet
+	pos = max(position, onDisk);
+	bcopy(&inode->delayed[pos - onDisk], &into[pos - position], 
+		end - pos);
+	if (pos == position)
+	    return numBytes;
+	end = pos;
+    }
+    if (hdr->DataInHeader()) {		// no sectors to read
+	hdr->ReadHeaderData(into, end - position, position);
+	return numBytes;
+    }
+    for (pos = position; pos < end; pos += amount) {
+	offset = pos % SectorSize;
+	sector = hdr->ByteToSector(pos);
+	if (offset == 0 && end - pos >= SectorSize) {	
+	    // whole sectors, straight into the caller's buffer
+	    count = ContiguousSectors(pos / SectorSize, end / SectorSize - 1);
+	    amount = count * SectorSize;
+	    if (sector == HoleSector)
+		memset(&into[pos - position], 0, amount);
+	    else
+		kernel->blockCache->ReadSectors(sector, count, 
+			&into[pos - position]);
+	} else {
+	    // part of a sector, through the staging buffer
+	    amount = min(end - pos, SectorSize - offset);
+	    if (sector == HoleSector)
+		memset(&into[pos - position], 0, amount);
+	    else {
+		kernel->blockCache->ReadSector(sector, staging);
+		bcopy(&staging[offset], &into[pos - position], amount);
+	    }
+	}
+    }
 
-    // copy the part we want
-    bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
-    delete [] buf;
+    ReadAhead(divRoundDown(position, SectorSize), 
+		divRoundDown(end - 1, SectorSize));
     return numBytes;
 }
 
 int
 OpenFile::WriteAt(char *from, int numBytes, int position)
+{
+    if (numBytes <= 0)
+	return 0;				// check request
+    if (position + numBytes > hdr->FileLength()) {
+	if (Delay(from, numBytes, position))
+	    return numBytes;
+	Flush(MaxGrowReserve);		// make room, or keep it in order
+	if (Delay(from, numBytes, position))
+	    return numBytes;
+    }
+    return WriteThrough(from, numBytes, position);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Delay
+// 	Keep data written past the end of the file in memory, without
+//	allocating sectors for it.  Bytes skipped over, between the end
+//	of the file and "position", read as zeros.
+//
+//	The free sectors the data will need are held for it now, so that
+//	Flush is sure to find them.  Return FALSE, so that the caller
+//	writes the data through instead, if the write starts before the
+//	end of the file, there is not room for it in memory or on disk,
+//	or the file ends in a hole, whose sectors could not be held.
+//
+//	"from" -- the buffer containing the data to be written
+//	"numBytes" -- the number of bytes to write
+//	"position" -- the offset within the file of the first byte
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Delay(char *from, int numBytes, int position)
+{
+    int start = hdr->FileLength();
+    int length = inode->delayedLength;
+    int needed;
+
+    if (position < start || position + numBytes - start > MaxDelayed
+		|| hdr->HoleSectors(start, hdr->Capacity()) > 0)
+	return FALSE;
+    needed = hdr->MaxSectorsToExtend(max(start + length, position + numBytes))
+		- inode->heldSectors;
+    if (needed > 0) {
+	if (!kernel->fileSystem->HoldSectors(needed))
+	    return FALSE;			// disk full
+	inode->heldSectors += needed;
+    }
+    if (inode->delayed == NULL)
+	inode->delayed = new char[MaxDelayed];
+    if (position - start > length)
+	memset(&inode->delayed[length], 0, position - start - length);
+    bcopy(from, &inode->delayed[position - start], numBytes);
+    inode->delayedLength = max(length, position + numBytes - start);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Flush
+// 	Give the data kept in memory past the end of the file its
+//	sectors, all at once, and write it to disk.  This cannot fail
+//	for lack of space: the sectors were held for the data when it
+//	was delayed.
+//
+//	The data is taken away from the in-core header before waiting
+//	for the disk, so that anyone writing to the file meanwhile
+//	starts over, past the new end.
+//
+//	"reserve" -- sectors to reserve past the data, for more to come
+//----------------------------------------------------------------------
+
+void
+OpenFile::Flush(int reserve)
+{
+    char *data = inode->delayed;
+    int length = inode->delayedLength;
+    int start = hdr->FileLength();
+
+    if (length == 0)
+	return;
+    DEBUG(dbgFile, "Flushing " << length << " bytes at " << start);
+    inode->delayed = NULL;
+    inode->delayedLength = 0;
+    reserve = min(divRoundUp(start + length, SectorSize), reserve);
+    ASSERT(Grow(start + length, reserve));
+    WriteThrough(data, length, start);
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::WriteThrough
+// 	Write a portion of the file to its sectors, growing the file,
+//	and allocating sectors right away, if it goes past the end.
+//	Return the number of bytes written.
+//
+//	"from" -- the buffer containing the data to be written to disk 
+//	"numBytes" -- the number of bytes to transfer
+//	"position" -- the offset within the file of the first byte
+//----------------------------------------------------------------------
+
+int
+OpenFile::WriteThrough(char *from, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
-    char *buf;
+    int end, pos, offset, amount, count, reserve;
+    bool firstHole, lastHole;
 
-    if ((numBytes <= 0) || (position >= fileLength))
-	return 0;				// check request
-    if ((position + numBytes) > fileLength)
+    end = position + numBytes;
+    reserve = min(divRoundUp(end, SectorSize), MaxGrowReserve);
+    if (position > fileLength) {
+	if (!Skip(position) || !Grow(end, reserve)) {
+	    kernel->fileSystem->Resize(this, fileLength);
+	    return 0;				// disk full
+	}
+    } else if (end > fileLength && !Grow(end, reserve)) {
+	if (position == fileLength)
+	    return 0;				// disk full
 	numBytes = fileLength - position;
+    }
     DEBUG(dbgFile, "Writing " << numBytes << " bytes at " << position << " from file of length " << fileLength);
+    if (hdr->DataInHeader()) {		// the header is the only sector
+	hdr->WriteHeaderData(from, numBytes, position);
+	inode->dirty = TRUE;
+	WriteBackHeader();
+	return numBytes;
+    }
 
-    firstSector = divRoundDown(position, SectorSize);
-    lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
-
-    buf = new char[numSectors * SectorSize];
-	
-	// Mp4 mod tag
-	memset(buf, 0, sizeof(char) * numSectors * SectorSize); // dummy operation to keep valgrind happy
-
-    firstAligned = (position == (firstSector * SectorSize));
-    lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
-
-// read in first and last sector, if they are to be partially modified
-    if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);	
-    if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize], 
-				SectorSize, lastSector * SectorSize);	
-
-// copy in the bytes we want to change 
-    bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
-
-// write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)	
-        kernel->synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
-    delete [] buf;
+    end = position + numBytes;
+    if (hdr->HoleSectors(position, end) > 0) {
+	// only the first and last sectors can be partly written; if
+	// they are new, they start out as zeros, not as what is on disk
+	firstHole = (hdr->ByteToSector(position) == HoleSector);
+	lastHole = (hdr->ByteToSector(end - 1) == HoleSector);
+	if (!kernel->fileSystem->FillHoles(this, position, end)) {
+	    kernel->fileSystem->Resize(this, fileLength);
+	    return 0;				// disk full
+	}
+    } else
+	firstHole = lastHole = FALSE;
+    for (pos = position; pos < end; pos += amount) {
+	offset = pos % SectorSize;
+	if (offset == 0 && end - pos >= SectorSize) {	
+	    // whole sectors, straight from the caller's buffer
+	    count = ContiguousSectors(pos / SectorSize, end / SectorSize - 1);
+	    kernel->blockCache->WriteSectors(hdr->ByteToSector(pos), count, 
+			&from[pos - position]);
+	    amount = count * SectorSize;
+	} else {
+	    // part of a sector: read it in (straight from the cache, so 
+	    // as not to disturb read-ahead), change our part, write it back
+	    amount = min(end - pos, SectorSize - offset);
+	    if ((pos / SectorSize == position / SectorSize) ? firstHole 
+			: lastHole)
+		memset(staging, 0, SectorSize);
+	    else
+		kernel->blockCache->ReadSector(hdr->ByteToSector(pos), staging);
+	    bcopy(&from[pos - position], &staging[offset], amount);
+	    kernel->blockCache->WriteSector(hdr->ByteToSector(pos), staging);
+	}
+    }
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::Grow
+// 	Make the file "newLength" bytes long, so that a write can go past
+//	its end.  If the sectors the file has reserved are not enough,
+//	the file system allocates more, reserving some beyond the new end
+//	for the writes that are likely to follow; otherwise, only the
+//	length changes -- unless free sectors are held for the file,
+//	which the file system must then be given back.  Either way, the
+//	new length goes to disk with the header, when the file is last
+//	closed.
+//
+//	Return FALSE, leaving the file as it was, if the disk is full.
+//
+//	"newLength" -- the length the file must grow to
+//	"reserve" -- sectors to reserve past the new end, if it needs more
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Grow(int newLength, int reserve)
+{
+    if (newLength <= hdr->Capacity() && inode->heldSectors == 0) {
+	hdr->Extend(NULL, newLength);	// has the sectors already
+	inode->dirty = TRUE;
+	return TRUE;
+    }
+    return kernel->fileSystem->Resize(this, newLength, reserve);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Skip
+// 	Make the file "position" bytes long, for a write that starts past
+//	its end.  The rest of the old last sector is cleared, since it
+//	may still hold whatever was there before the file was truncated
+//	or the sector was allocated; the whole sectors skipped over are
+//	left in a hole, which reads as zeros without being allocated or
+//	written, until something is written there.
+//
+//	Return FALSE if the disk is full; the caller then gives the file
+//	back its old length.
+//
+//	"position" -- where the write starts
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Skip(int position)
+{
+    int fileLength = hdr->FileLength();
+    int end = min(position, divRoundUp(fileLength, SectorSize) * SectorSize);
+    char *zeros;
+
+    if (end > fileLength && !hdr->DataInHeader()) {
+	// the rest of the last sector, which the file has already
+	zeros = new char[end - fileLength];
+	memset(zeros, 0, end - fileLength);
+	WriteThrough(zeros, end - fileLength, fileLength);
+	delete [] zeros;
+    }
+    if (position > hdr->FileLength())
+	return kernel->fileSystem->Resize(this, position, 0, TRUE);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Called after ReadAt has read file sectors "firstSector" through 
+//	"lastSector".  If the read picks up where the previous one left 
+//	off, the file is being read sequentially, so grow the read-ahead 
+//	window; otherwise, stop reading ahead.
+//
+//	The block cache is then asked to prefetch the sectors in the 
+//	window that it has not been asked for yet.  To keep each request
+//	large, this is only done once less than half a window is left 
+//	outstanding.  The prefetch is issued right after the demand read,
+//	while the disk head is still over the same track, so the sectors
+//	that follow are cheap to get -- often straight from the disk's
+//	track buffer.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadAhead(int firstSector, int lastSector)
+{
+    int numSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    int start, end, count;
+
+    if (firstSector == lastSectorRead || firstSector == lastSectorRead + 1) {
+	if (readAheadWindow == 0)
+	    readAheadWindow = MinReadAhead;
+	else
+	    readAheadWindow = min(2 * readAheadWindow, MaxReadAhead);
+    } else {
+	readAheadWindow = 0;		// random access
+	readAheadLimit = lastSector + 1;
+    }
+    lastSectorRead = lastSector;
+
+    if (readAheadWindow == 0 
+		|| readAheadLimit - (lastSector + 1) > readAheadWindow / 2)
+	return;
+    start = max(readAheadLimit, lastSector + 1);
+    end = min(lastSector + 1 + readAheadWindow, numSectors);
+    for (; start < end; start += count) {
+	count = ContiguousSectors(start, end - 1);
+	if (hdr->ByteToSector(start * SectorSize) != HoleSector)
+	    kernel->blockCache->Prefetch(hdr->ByteToSector(start * SectorSize),
+					count);
+    }
+    readAheadLimit = max(readAheadLimit, end);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ContiguousSectors
+// 	Return the number of sectors of the file, starting with sector
+//	"fileSector" and going no further than "lastSector", that are 
+//	stored one after another on disk -- that is, that can be
+//	transferred as a single run.  If "fileSector" is in a hole,
+//	return how many of them are in the hole.
+//----------------------------------------------------------------------
+
+int
+OpenFile::ContiguousSectors(int fileSector, int lastSector)
+{
+    int sector = hdr->ByteToSector(fileSector * SectorSize);
+    int count = 1;
+
+    while (fileSector + count <= lastSector && 
+	hdr->ByteToSector((fileSector + count) * SectorSize) 
+		== ((sector == HoleSector) ? HoleSector : sector + count))
+	count++;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Resize
+// 	Change the length of the file to "newLength" bytes.  A longer file
+//	gets more sectors from the map of free sectors, and "reserve" more
+//	past its new end if there is room -- or, if "sparse", a hole 
+//	instead; a shorter one returns the sectors past its new end,
+//	including any it had reserved.  The new file header is written
+//	back to disk when the file is last closed, but the caller is
+//	responsible for writing back the free map.
+//
+//	Growing the file past the data delayed in memory uses up the free
+//	sectors held for that data, so they are given back to the map
+//	first (cf. OpenFile::Delay).
+//
+//	Return FALSE, leaving the file unchanged, if there is not enough
+//	free space to grow the file.
+//
+//	"freeMap" -- the bit map of free disk sectors
+//	"newLength" -- the new length of the file, in bytes
+//	"reserve" -- sectors to reserve past the new end, if it grows
+//	"sparse" -- whether to leave the new sectors unallocated
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Resize(PersistentBitmap *freeMap, int newLength, int reserve,
+			bool sparse)
+{
+    int held = inode->heldSectors;
+
+    if (newLength > hdr->FileLength()) {
+	if (newLength < hdr->FileLength() + inode->delayedLength)
+	    held = 0;			// still needed for the rest
+	freeMap->Unhold(held);
+	if (!hdr->Extend(freeMap, newLength, reserve, sparse)) {
+	    ASSERT(freeMap->Hold(held));	// nothing was taken
+	    return FALSE;
+	}
+	inode->heldSectors -= held;
+    } else if (newLength < hdr->FileLength() 
+		|| hdr->Capacity() - newLength >= SectorSize)
+	hdr->Truncate(freeMap, newLength);
+    else
+	return TRUE;
+    inode->dirty = TRUE;
+    readAheadLimit = min(readAheadLimit, 
+			divRoundUp(newLength, SectorSize));
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::FillHoles
+// 	Give sectors to the blocks of the file from byte "from" up to
+//	byte "to" that are in holes, taking them from the map of free
+//	sectors.  As for Resize, the new header is written back when the
+//	file is last closed, and the caller writes back the free map.
+//
+//	Return FALSE, leaving the file unchanged, if there is not enough
+//	free space.
+//
+//	"freeMap" -- the bit map of free disk sectors
+//	"from", "to" -- the byte range of the file about to be written
+//----------------------------------------------------------------------
+
+bool
+OpenFile::FillHoles(PersistentBitmap *freeMap, int from, int to)
+{
+    if (!hdr->FillHoles(freeMap, from, to))
+	return FALSE;
+    inode->dirty = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::WriteBackHeader
+// 	Write the file header back to disk now, if it has changed, rather
+//	than waiting for the file to be last closed.  Used by operations
+//	that must get the new header into the journal along with the
+//	rest of their changes.
+//----------------------------------------------------------------------
+
+void
+OpenFile::WriteBackHeader()
+{
+    if (inode->dirty) {
+	inode->dirty = FALSE;
+	hdr->WriteBack(inode->sector);
+    }
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
 // 	Return the number of bytes in the file.
@@ -193,7 +620,7 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
 int
 OpenFile::Length() 
 { 
-    return hdr->FileLength(); 
+    return hdr->FileLength() + inode->delayedLength; 
 }
 
 #endif //FILESYS_STUB
@@ -61,6 +61,8 @@ class OpenFile {
 
 #else // FILESYS
 class FileHeader;
+class Inode;
+class PersistentBitmap;
 
 class OpenFile {
   public:
@@ -86,10 +88,56 @@ class OpenFile {
 					// file (this interface is simpler 
 					// than the UNIX idiom -- lseek to 
 					// end of file, tell, lseek back 
+
+    bool Resize(PersistentBitmap *freeMap, int newLength, int reserve = 0,
+			bool sparse = FALSE);
+					// Grow or shrink the file, taking
+					// sectors from or returning them to
+					// "freeMap", and mark the header 
+					// dirty.  FALSE if the disk is full.
+    bool FillHoles(PersistentBitmap *freeMap, int from, int to);
+					// Give sectors to the holes in a
+					// range of the file, taking them
+					// from "freeMap".  FALSE if the disk
+					// is full.
+    void WriteBackHeader();		// Write the header back now, if it
+					// is dirty, rather than on last close
+    void Flush(int reserve = 0);	// Give data written past the end of
+					// the file its sectors, and write
+					// it to disk
     
   private:
+    Inode *inode;			// In-core header for this file,
+					// shared with other opens of it
     FileHeader *hdr;			// Header for this file 
     int seekPosition;			// Current position within the file
+    int lastSectorRead;			// Last file sector read by ReadAt
+    int readAheadWindow;		// How many sectors to keep read 
+					// ahead of the reader; 0 if it
+					// is not reading sequentially
+    int readAheadLimit;			// First file sector not yet asked
+					// to be read ahead
+    char *staging;			// Holds a sector that is only partly
+					// read or written
+
+    bool Delay(char *from, int numBytes, int position);
+					// Keep data written past the end of
+					// the file in memory, if it fits
+    int WriteThrough(char *from, int numBytes, int position);
+					// Write data to the file's sectors,
+					// allocating them if need be
+    bool Grow(int newLength, int reserve);
+					// Make the file longer, to write
+					// past its end
+    bool Skip(int position);		// Extend the file, with a hole,
+					// to a write past its end
+    void ReadAhead(int firstSector, int lastSector);
+					// Adjust the read-ahead window after
+					// a read, and prefetch accordingly
+    int ContiguousSectors(int fileSector, int lastSector);
+					// How many file sectors, starting at
+					// "fileSector", lie one after another
+					// on disk
 };
 
 #endif // FILESYS
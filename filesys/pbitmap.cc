@@ -7,8 +7,13 @@
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
+#include "debug.h"
+#include "disk.h"
 #include "pbitmap.h"
 
+// Number of bits of the map stored in each sector of its file
+#define BitsInSector (SectorSize * BitsInByte)
+
 //----------------------------------------------------------------------
 // PersistentBitmap::PersistentBitmap(int)
 // 	Initialize a bitmap with "numItems" bits, so that every bit is clear.
@@ -21,6 +26,10 @@
 
 PersistentBitmap::PersistentBitmap(int numItems):Bitmap(numItems) 
 { 
+    numMapSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    sectorDirty = new bool[numMapSectors];
+    numHeld = 0;
+    SetDirty(TRUE);			// nothing is on disk yet
 }
 
 //----------------------------------------------------------------------
@@ -40,7 +49,10 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems
     // map has already been initialized by the BitMap constructor,
     // but we will just overwrite that with the contents of the
     // map found in the file
-    file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    numMapSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    sectorDirty = new bool[numMapSectors];
+    numHeld = 0;
+    FetchFrom(file);
 }
 
 //----------------------------------------------------------------------
@@ -50,6 +62,78 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems
 
 PersistentBitmap::~PersistentBitmap()
 { 
+    delete [] sectorDirty;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::SetDirty
+// 	Mark every sector of the bitmap as changed, or as unchanged.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::SetDirty(bool dirty)
+{
+    for (int i = 0; i < numMapSectors; i++)
+	sectorDirty[i] = dirty;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Mark, PersistentBitmap::Clear
+// 	Set or clear the "nth" bit, and remember that the sector of the
+//	bitmap holding it must be written back.
+//
+//	"which" is the number of the bit.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Mark(int which)
+{
+    Bitmap::Mark(which);
+    sectorDirty[which / BitsInSector] = TRUE;
+}
+
+void
+PersistentBitmap::Clear(int which)
+{
+    Bitmap::Clear(which);
+    sectorDirty[which / BitsInSector] = TRUE;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Hold, PersistentBitmap::Unhold
+// 	Set aside "count" clear bits, without choosing which, or give
+//	them back.  Hold returns FALSE, setting none aside, if fewer than
+//	"count" clear bits are not held already.
+//
+//	"count" is the number of bits.
+//----------------------------------------------------------------------
+
+bool
+PersistentBitmap::Hold(int count)
+{
+    if (NumFree() < count)
+	return FALSE;
+    numHeld += count;
+    return TRUE;
+}
+
+void
+PersistentBitmap::Unhold(int count)
+{
+    ASSERT(count <= numHeld);
+    numHeld -= count;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::NumFree
+// 	Return the number of clear bits that are not held, which are all
+//	that can be set without breaking a promise made by Hold.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::NumFree()
+{
+    return NumClear() - numHeld;
 }
 
 //----------------------------------------------------------------------
@@ -63,11 +147,16 @@ void
 PersistentBitmap::FetchFrom(OpenFile *file) 
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    Recount();
+    SetDirty(FALSE);
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::WriteBack
 // 	Store the contents of a persistent bitmap to a Nachos file.
+//	Only the sectors holding bits that changed since the bitmap was
+//	last fetched or written are written; a run of consecutive changed
+//	sectors is written in one go.
 //
 //	"file" is the place to write the bitmap to
 //----------------------------------------------------------------------
@@ -75,5 +164,18 @@ PersistentBitmap::FetchFrom(OpenFile *file)
 void
 PersistentBitmap::WriteBack(OpenFile *file)
 {
-   file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    int mapBytes = numWords * sizeof(unsigned);
+    int first, last, end;
+
+    for (first = 0; first < numMapSectors; first = last) {
+	if (!sectorDirty[first]) {
+	    last = first + 1;
+	    continue;
+	}
+	for (last = first; last < numMapSectors && sectorDirty[last]; last++)
+	    sectorDirty[last] = FALSE;
+	end = min(last * SectorSize, mapBytes);
+	file->WriteAt((char *)map + first * SectorSize, 
+			end - first * SectorSize, first * SectorSize);
+    }
 }
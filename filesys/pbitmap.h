@@ -6,6 +6,14 @@
 //    when it is created, or it can be initialized later using
 //    the FetchFrom method
 //
+//    The bitmap remembers which sectors of its file hold bits that
+//    have changed, and WriteBack only writes those.
+//
+//    Clear bits can also be held -- set aside, without choosing which,
+//    for someone who is going to set that many later.  The file system
+//    holds free sectors for data kept in memory until it is given
+//    sectors, so that there are sure to be enough then.
+//
 // Copyright (c) 1992,1993,1995 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -28,8 +36,25 @@ class PersistentBitmap : public Bitmap {
 
     ~PersistentBitmap(); 			// deallocate bitmap
 
+    void Mark(int which);		// Set/clear the "nth" bit, and
+    void Clear(int which);		// remember that its sector changed
+
+    bool Hold(int count);		// Set aside "count" clear bits, or
+					// return FALSE if there are not
+					// that many not already held
+    void Unhold(int count);		// Give back bits set aside
+    int NumFree();			// Clear bits not held
+
     void FetchFrom(OpenFile *file);     // read bitmap from the disk
-    void WriteBack(OpenFile *file); 	// write bitmap contents to disk 
+    void WriteBack(OpenFile *file); 	// write changed parts of bitmap
+					// contents to disk 
+
+  private:
+    int numMapSectors;			// Sectors the bitmap occupies
+    bool *sectorDirty;			// Which of them WriteBack must write
+    int numHeld;			// Clear bits set aside by Hold
+
+    void SetDirty(bool dirty);		// Mark every sector (un)changed
 };
 
 #endif // PBITMAP_H
@@ -0,0 +1,113 @@
+// superblock.cc
+//	Routines to read and write the file system superblock.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "superblock.h"
+#include "blockcache.h"
+#include "main.h"
+
+// Number of words of the superblock stored on disk
+#define SuperBlockWords 	9
+
+//----------------------------------------------------------------------
+// SuperBlock::SuperBlock
+// 	Initialize a superblock describing a file system on the disk
+//	as it is now, ready to be written out when the disk is formatted.
+//	The file system fills in where it puts the journal, and the
+//	counts.
+//----------------------------------------------------------------------
+
+SuperBlock::SuperBlock()
+{
+    magic = SuperBlockMagic;
+    sectorSize = SectorSize;
+    sectorsPerTrack = SectorsPerTrack;
+    numTracks = NumTracks;
+    journalStart = journalSectors = 0;
+    freeSectors = numHeaders = 0;
+    clean = FALSE;
+}
+
+//----------------------------------------------------------------------
+// SuperBlock::FetchFrom
+// 	Read the contents of the superblock from disk.
+//
+//	"sector" is the disk sector containing the superblock
+//----------------------------------------------------------------------
+
+void
+SuperBlock::FetchFrom(int sector)
+{
+    int *buf = new int[SectorSize / sizeof(int)];
+
+    kernel->blockCache->ReadSector(sector, (char *)buf);
+    Decode(buf);
+    delete [] buf;
+}
+
+//----------------------------------------------------------------------
+// SuperBlock::Decode
+// 	Initialize the superblock from the contents of its sector,
+//	already read in by the caller.
+//
+//	"buf" -- the sector containing the superblock
+//----------------------------------------------------------------------
+
+void
+SuperBlock::Decode(int *buf)
+{
+    magic = buf[0];
+    sectorSize = buf[1];
+    sectorsPerTrack = buf[2];
+    numTracks = buf[3];
+    journalStart = buf[4];
+    journalSectors = buf[5];
+    freeSectors = buf[6];
+    numHeaders = buf[7];
+    clean = (buf[8] != 0);
+}
+
+//----------------------------------------------------------------------
+// SuperBlock::WriteBack
+// 	Write the contents of the superblock back to disk.
+//
+//	"sector" is the disk sector to contain the superblock
+//----------------------------------------------------------------------
+
+void
+SuperBlock::WriteBack(int sector)
+{
+    int *buf = new int[SectorSize / sizeof(int)];
+
+    ASSERT(SuperBlockWords * sizeof(int) <= (unsigned) SectorSize);
+    memset(buf, 0, SectorSize);
+    buf[0] = magic;
+    buf[1] = sectorSize;
+    buf[2] = sectorsPerTrack;
+    buf[3] = numTracks;
+    buf[4] = journalStart;
+    buf[5] = journalSectors;
+    buf[6] = freeSectors;
+    buf[7] = numHeaders;
+    buf[8] = clean;
+    kernel->blockCache->WriteSector(sector, (char *)buf);
+    delete [] buf;
+}
+
+//----------------------------------------------------------------------
+// SuperBlock::Matches
+// 	Return TRUE if the superblock was written when a file system was
+//	formatted onto a disk with the same geometry as the one we have.
+//----------------------------------------------------------------------
+
+bool
+SuperBlock::Matches()
+{
+    return magic == SuperBlockMagic && sectorSize == SectorSize 
+		&& sectorsPerTrack == SectorsPerTrack 
+		&& numTracks == NumTracks;
+}
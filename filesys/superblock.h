@@ -0,0 +1,71 @@
+// superblock.h
+//	Data structures for the file system "superblock" -- the sector
+//	at a well-known place on disk describing the file system as a
+//	whole.
+//
+//	The geometry of the disk is chosen when the disk is formatted,
+//	and recorded in the superblock, so that when Nachos boots from an
+//	existing disk, the file system can check that it is looking at
+//	the disk it was built for.  The superblock also says where the
+//	journal (cf. journal.h) is.
+//
+//	The superblock also keeps count of the free sectors and of the
+//	file headers in use, and whether the file system was cleanly
+//	unmounted.  The flag is cleared when the file system is mounted,
+//	and set again, with the counts brought up to date, when it is
+//	unmounted; so finding it clear at mount time means Nachos stopped
+//	without unmounting, and the bitmap and counts must be checked.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef SUPERBLOCK_H
+#define SUPERBLOCK_H
+
+#include "disk.h"
+
+const int SuperBlockMagic = 0x4e465333;	// "NFS3"
+
+// Sectors containing the superblock, and the file headers for the bitmap
+// of free sectors and the directory of files.  These are placed in
+// well-known sectors, so that they can be located on boot-up.
+#define SuperBlockSector 	0
+#define FreeMapSector 		1
+#define DirectorySector 	2
+
+// The following class defines the superblock.  Like a file header,
+// it is read into memory by FetchFrom, and written back to its sector
+// by WriteBack; the rest of the sector is unused.
+//
+// Internal data structures kept public so that the file system can
+// access them directly.
+
+class SuperBlock {
+  public:
+    SuperBlock();			// Describe the disk as it is now
+
+    void FetchFrom(int sectorNumber);	// Read the superblock from disk
+    void WriteBack(int sectorNumber);	// Write it back to disk
+    void Decode(int *buf);		// Initialize it from a copy of
+					// its sector
+    bool Matches();			// Does the superblock describe 
+					// a file system for this disk?
+
+    int magic;				// SuperBlockMagic, if formatted
+    int sectorSize;			// Geometry of the disk when it
+    int sectorsPerTrack;		// was formatted
+    int numTracks;
+    int journalStart;			// First sector of the journal
+    int journalSectors;			// Size of the journal, in sectors
+    int freeSectors;			// Sectors free at the last unmount
+    int numHeaders;			// File headers in use (including
+					// those of the bitmap and root
+					// directory)
+    bool clean;				// Was the file system unmounted
+					// since it was last mounted?
+};
+
+#endif // SUPERBLOCK_H
@@ -5,10 +5,21 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	Each request has a semaphore, which the disk interrupt handler
+//	signals when the request is done.  Because the physical disk can
+//	only handle one operation at a time, requests that arrive while
+//	it is busy wait in a queue.  Each time the disk finishes, the
+//	scheduling policy picks the next one:
+//
+//	   FCFS -- the oldest request
+//	   SSTF -- the request on the track nearest the head
+//	   SCAN -- the nearest request in the direction the head is
+//		moving; the head turns around when there is none ahead
+//	   C-LOOK -- the nearest request at or above the head; after the
+//		highest one, the head jumps back to the lowest
+//
+//	The queue is shared with the interrupt handler, so it is
+//	protected by disabling interrupts.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -16,20 +27,62 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "main.h"
+
+
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Initialize a request to read/write "count" consecutive sectors,
+//	starting at "sector", all on the same track.  The data is either
+//	in "buffer", or if "buffers" is not NULL, a sector in each of
+//	"buffers".
+//----------------------------------------------------------------------
 
+DiskRequest::DiskRequest(int sector, int count, char *buffer, char **buffers,
+				bool write)
+{
+    sectorNumber = sector;
+    numSectors = count;
+    data = buffer;
+    sectors = buffers;
+    writing = write;
+    arrivalTime = kernel->stats->totalTicks;
+    done = new Semaphore("disk request", 0);
+}
+
+DiskRequest::~DiskRequest()
+{
+    delete done;
+}
 
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
 // 	Initialize the synchronous interface to the physical disk, in turn
 //	initializing the physical disk.
 //
+//	"policyName" -- the disk scheduling policy to use
+//	"mapped" -- should the disk's UNIX file be mapped into memory?
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk()
+SynchDisk::SynchDisk(char *policyName, bool mapped)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
-    disk = new Disk(this);
+    policy = DiskFCFS;
+    if (policyName == NULL || strcmp(policyName, "fcfs") == 0)
+	policy = DiskFCFS;
+    else if (strcmp(policyName, "sstf") == 0)
+	policy = DiskSSTF;
+    else if (strcmp(policyName, "scan") == 0)
+	policy = DiskSCAN;
+    else if (strcmp(policyName, "clook") == 0)
+	policy = DiskCLOOK;
+    else
+	cerr << "Unknown disk scheduling policy " << policyName 
+		<< ", using fcfs\n";
+    queue = new List<DiskRequest *>;
+    active = NULL;
+    headTrack = 0;
+    movingUp = TRUE;
+    disk = new Disk(this, mapped);
 }
 
 //----------------------------------------------------------------------
@@ -40,9 +93,9 @@ SynchDisk::SynchDisk()
 
 SynchDisk::~SynchDisk()
 {
+    ASSERT(active == NULL && queue->IsEmpty());
     delete disk;
-    delete lock;
-    delete semaphore;
+    delete queue;
 }
 
 //----------------------------------------------------------------------
@@ -57,10 +110,7 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    Request(sectorNumber, 1, data, NULL, FALSE);
 }
 
 //----------------------------------------------------------------------
@@ -75,20 +125,260 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    Request(sectorNumber, 1, data, NULL, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors
+// 	Read the contents of "numSectors" consecutive disk sectors into a 
+//	buffer, or into a separate buffer for each sector.  Return only 
+//	after all the data has been read.
+//
+//	"sectorNumber" -- the first disk sector to read
+//	"numSectors" -- the number of sectors to read
+//	"data" -- the buffer to hold the contents of the disk sectors
+//	"sectors" -- the buffers to hold each disk sector
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadSectors(int sectorNumber, int numSectors, char* data)
+{
+    Split(sectorNumber, numSectors, data, NULL, FALSE);
+}
+
+void
+SynchDisk::ReadSectors(int sectorNumber, int numSectors, char** sectors)
+{
+    Split(sectorNumber, numSectors, NULL, sectors, FALSE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteSectors
+// 	Write the contents of a buffer, or of a separate buffer for each
+//	sector, into "numSectors" consecutive disk sectors.  Return only 
+//	after all the data has been written.
+//
+//	"sectorNumber" -- the first disk sector to be written
+//	"numSectors" -- the number of sectors to write
+//	"data" -- the new contents of the disk sectors
+//	"sectors" -- the new contents of each disk sector
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteSectors(int sectorNumber, int numSectors, char* data)
+{
+    Split(sectorNumber, numSectors, data, NULL, TRUE);
+}
+
+void
+SynchDisk::WriteSectors(int sectorNumber, int numSectors, char** sectors)
+{
+    Split(sectorNumber, numSectors, NULL, sectors, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Split
+// 	Read or write a run of consecutive sectors.  The disk can only
+//	transfer sectors on a single track per request, so the run is
+//	broken up at each track boundary.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Split(int sectorNumber, int numSectors, char* data, 
+			char** sectors, bool writing)
+{
+    int count;
+
+    while (numSectors > 0) {
+	count = min(numSectors, SectorsPerTrack - sectorNumber % SectorsPerTrack);
+	Request(sectorNumber, count, data, sectors, writing);
+	sectorNumber += count;
+	numSectors -= count;
+	if (sectors != NULL)
+	    sectors += count;
+	else
+	    data += count * SectorSize;
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Request
+// 	Send a request to the disk if it is idle, or else queue it until
+//	the scheduler picks it.  Either way, wait until it is done.
+//
+//	The queue is shared with the disk interrupt handler, so it is
+//	protected by disabling interrupts rather than with a lock.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Request(int sectorNumber, int numSectors, char* data, 
+			char** sectors, bool writing)
+{
+    DiskRequest *request = new DiskRequest(sectorNumber, numSectors, 
+						data, sectors, writing);
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    if (active == NULL)
+	Start(request);
+    else
+	queue->Append(request);
+    request->done->P();			// wait for interrupt
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    delete request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Start
+// 	Send a request to the disk, and account for the seek it needs.
+//	Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Start(DiskRequest *request)
+{
+    int track = request->sectorNumber / SectorsPerTrack;
+
+    ASSERT(active == NULL);
+    DEBUG(dbgDisk, "Scheduling request for track " << track 
+		<< ", head at track " << headTrack);
+    if (track != headTrack)
+	movingUp = (track > headTrack);
+    kernel->stats->diskSeekTracks += abs(track - headTrack);
+    headTrack = track;
+    active = request;
+    if (request->sectors != NULL && request->writing)
+	disk->WriteRequest(request->sectorNumber, request->sectors, 
+				request->numSectors);
+    else if (request->sectors != NULL)
+	disk->ReadRequest(request->sectorNumber, request->sectors, 
+				request->numSectors);
+    else if (request->writing)
+	disk->WriteRequest(request->sectorNumber, request->data, 
+				request->numSectors);
+    else
+	disk->ReadRequest(request->sectorNumber, request->data, 
+				request->numSectors);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::NextRequest
+// 	Remove and return the queued request that the scheduling policy
+//	says should be served next.  The queue must not be empty.
+//
+//	Ties between requests on the same track go to the one that 
+//	arrived first.
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::NextRequest()
+{
+    ListIterator<DiskRequest *> ahead(queue);
+    ListIterator<DiskRequest *> iter(queue);
+    DiskRequest *best = NULL;
+    DiskRequest *lowest = NULL;
+    DiskRequest *request;
+    int track, bestTrack = 0;
+
+    ASSERT(!queue->IsEmpty());
+    if (policy == DiskFCFS)
+	return queue->RemoveFront();
+
+    if (policy == DiskSCAN) {		// anything ahead of us?
+	for (; !ahead.IsDone(); ahead.Next()) {
+	    track = ahead.Item()->sectorNumber / SectorsPerTrack;
+	    if ((movingUp && track >= headTrack) 
+			|| (!movingUp && track <= headTrack))
+		break;
+	}
+	if (ahead.IsDone())
+	    movingUp = !movingUp;	// no, turn around
+    }
+
+    for (; !iter.IsDone(); iter.Next()) {
+	request = iter.Item();
+	track = request->sectorNumber / SectorsPerTrack;
+	switch (policy) {
+	  case DiskSSTF:
+	    if (best == NULL || abs(track - headTrack) < abs(bestTrack - headTrack))
+		best = request;
+	    break;
+	  case DiskSCAN:
+	    if ((movingUp && track >= headTrack) 
+			|| (!movingUp && track <= headTrack))
+		if (best == NULL || abs(track - headTrack) < abs(bestTrack - headTrack))
+		    best = request;
+	    break;
+	  case DiskCLOOK:
+	    if (track >= headTrack && (best == NULL || track < bestTrack))
+		best = request;
+	    if (lowest == NULL || track < lowest->sectorNumber / SectorsPerTrack)
+		lowest = request;
+	    break;
+	  default:
+	    ASSERTNOTREACHED();
+	}
+	if (best == request)
+	    bestTrack = track;
+    }
+    if (best == NULL)			// C-LOOK: wrap around
+	best = lowest;
+    ASSERT(best != NULL);
+    queue->Remove(best);
+    return best;
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::CallBack
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler.  Wake up the thread waiting for the disk
+//	request to finish, and start the next request, if any.
 //----------------------------------------------------------------------
 
 void
 SynchDisk::CallBack()
 { 
-    semaphore->V();
+    DiskRequest *finished = active;
+
+    ASSERT(finished != NULL);
+    kernel->stats->diskRequestTicks += 
+		kernel->stats->totalTicks - finished->arrivalTime;
+    active = NULL;
+    if (!queue->IsEmpty())
+	Start(NextRequest());
+    finished->done->V();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush
+// 	Make sure every sector written so far has reached the UNIX file
+//	simulating the disk.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Flush()
+{
+    disk->Flush();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::PrintStats
+// 	Print how well the scheduling policy did: the average number of
+//	tracks the head moved, and the average time from queueing a
+//	request until it completed.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::PrintStats()
+{
+    static const char *policyNames[] = { "fcfs", "sstf", "scan", "clook" };
+    Statistics *stats = kernel->stats;
+    int numRequests = stats->numDiskReads + stats->numDiskWrites;
+
+    cout << "Disk scheduling (" << policyNames[policy] << "): requests " 
+		<< numRequests;
+    if (numRequests > 0)
+	cout << ", average seek " 
+		<< (double) stats->diskSeekTracks / numRequests << " tracks"
+		<< ", average latency " 
+		<< (double) stats->diskRequestTicks / numRequests << " ticks";
+    cout << "\n";
 }
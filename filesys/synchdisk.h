@@ -14,6 +14,39 @@
 #include "disk.h"
 #include "synch.h"
 #include "callback.h"
+#include "list.h"
+
+// The order in which queued disk requests are served.  Each policy
+// looks only at the track of the request's first sector.
+
+enum DiskSchedPolicy {
+    DiskFCFS,		// first come, first served
+    DiskSSTF,		// shortest seek (from the current track) first
+    DiskSCAN,		// elevator: keep moving in one direction, serving 
+			// the nearest request, until there are none left 
+			// ahead; then reverse
+    DiskCLOOK		// circular elevator: serve requests in increasing
+			// track order, then jump back to the lowest one
+};
+
+// The following class defines a single request waiting for the disk.
+
+class DiskRequest {
+  public:
+    DiskRequest(int sector, int count, char *buffer, char **buffers, 
+			bool write);
+    ~DiskRequest();
+
+    int sectorNumber;			// First sector to transfer
+    int numSectors;			// Consecutive sectors, on one track
+    char *data;				// Where the data comes from/goes to
+    char **sectors;			// Or, if not NULL, where each 
+					// sector comes from/goes to
+    bool writing;			// Write, rather than read?
+    int arrivalTime;			// When the request was queued
+    Semaphore *done;			// Signalled when the request is 
+					// complete
+};
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -25,11 +58,21 @@
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
 // returning.
+//
+// Any number of threads may have a request outstanding at once.  While
+// the disk is busy, new requests are queued; each time the disk 
+// finishes, the scheduling policy picks the next request to send it.
 
 class SynchDisk : public CallBackObj {
   public:
-    SynchDisk();    		        // Initialize a synchronous disk,
+    SynchDisk(char *policyName, bool mapped = FALSE);
+					// Initialize a synchronous disk,
 					// by initializing the raw Disk.
+					// "policyName" picks the scheduling
+					// policy: "fcfs" (the default, if
+					// NULL), "sstf", "scan" or "clook";
+					// "mapped" maps the disk's UNIX file
+					// into memory
     ~SynchDisk();			// De-allocate the synch disk data
     
     void ReadSector(int sectorNumber, char* data);
@@ -39,17 +82,48 @@ class SynchDisk : public CallBackObj {
     					// Disk::ReadRequest/WriteRequest and
 					// then wait until the request is done.
     void WriteSector(int sectorNumber, char* data);
+
+    void ReadSectors(int sectorNumber, int numSectors, char* data);
+					// Read/write a run of consecutive
+					// sectors.  The run is split at track
+					// boundaries; each piece is sent to
+					// the disk as a single request, 
+					// paying for the seek and rotational
+					// delay only once.
+    void WriteSectors(int sectorNumber, int numSectors, char* data);
+    void ReadSectors(int sectorNumber, int numSectors, char** sectors);
+    void WriteSectors(int sectorNumber, int numSectors, char** sectors);
+					// The same, but each sector has
+					// a buffer of its own
     
     void CallBack();			// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
 
+    void Flush();			// Make sure every sector written
+					// has reached the UNIX file
+
+    void PrintStats();			// Print the average seek distance 
+					// and latency under this policy
+
   private:
     Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
+    DiskSchedPolicy policy;		// How to pick the next request
+    List<DiskRequest *> *queue;		// Requests waiting for the disk
+    DiskRequest *active;		// Request the disk is working on,
+					// or NULL if the disk is idle
+    int headTrack;			// Track the head is over
+    bool movingUp;			// SCAN: moving towards higher tracks?
+
+    void Request(int sectorNumber, int numSectors, char* data, 
+			char** sectors, bool writing);	
+					// Queue a request, and wait for it
+    void Split(int sectorNumber, int numSectors, char* data, 
+			char** sectors, bool writing);
+					// Request a run, a track at a time
+    void Start(DiskRequest *request);	// Send a request to the disk
+    DiskRequest *NextRequest();		// Pick and dequeue the request to
+					// serve next
 };
 
 #endif // SYNCHDISK_H
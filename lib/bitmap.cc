@@ -2,6 +2,9 @@
 //	Routines to manage a bitmap -- an array of bits each of which
 //	can be either on or off.  Represented as an array of integers.
 //
+//	Bits past the end of the bitmap, in the last word, are kept set,
+//	so that searching a word at a time never finds them.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -10,6 +13,84 @@
 #include "debug.h"
 #include "bitmap.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const unsigned int AllSet = ~0U;	// a word with every bit in use
+
+//----------------------------------------------------------------------
+// CountTrailingZeros, CountOnes
+//	Bit twiddling on a single word of the bitmap, using the 
+//	compiler's builtins (and so the machine's instructions, if it
+//	has them) where we can.
+//----------------------------------------------------------------------
+
+static inline int
+CountTrailingZeros(unsigned int word)
+{
+    ASSERT(word != 0);
+#ifdef __GNUC__
+    return __builtin_ctz(word);
+#else
+    int n = 0;
+
+    while (!(word & 1)) {
+	word >>= 1;
+	n++;
+    }
+    return n;
+#endif
+}
+
+static inline int
+CountOnes(unsigned int word)
+{
+#ifdef __GNUC__
+    return __builtin_popcount(word);
+#else
+    int n = 0;
+
+    for (; word != 0; word &= word - 1)
+	n++;
+    return n;
+#endif
+}
+
+//----------------------------------------------------------------------
+// SkipFullWords
+//	Return the index of the first word, starting at "w", that is
+//	not entirely set, or "numWords" if there is none.  With SSE2 or
+//	AVX2, four or eight words are compared at once.
+//----------------------------------------------------------------------
+
+static inline int
+SkipFullWords(const unsigned int *map, int w, int numWords)
+{
+#if defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi32(-1);
+
+    for (; w + 8 <= numWords; w += 8) {
+	__m256i v = _mm256_loadu_si256((const __m256i *) &map[w]);
+	if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(v, ones)) != -1)
+	    break;
+    }
+#elif defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi32(-1);
+
+    for (; w + 4 <= numWords; w += 4) {
+	__m128i v = _mm_loadu_si128((const __m128i *) &map[w]);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, ones)) != 0xffff)
+	    break;
+    }
+#endif
+    while (w < numWords && map[w] == AllSet)
+	w++;
+    return w;
+}
+
 //----------------------------------------------------------------------
 // BitMap::BitMap
 // 	Initialize a bitmap with "numItems" bits, so that every bit is clear.
@@ -30,9 +111,8 @@ Bitmap::Bitmap(int numItems)
     for (i = 0; i < numWords; i++) {
 	map[i] = 0;		// initialize map to keep Purify happy
     }
-    for (i = 0; i < numBits; i++) {
-        Clear(i);
-    }
+    hint = 0;
+    Recount();
 }
 
 //----------------------------------------------------------------------
@@ -45,6 +125,23 @@ Bitmap::~Bitmap()
     delete [] map;
 }
 
+//----------------------------------------------------------------------
+// Bitmap::Recount
+// 	Set the bits past the end of the bitmap, and count the clear 
+//	bits.  Called whenever the contents of "map" have been replaced
+//	wholesale, for instance by reading it in from disk.
+//----------------------------------------------------------------------
+
+void
+Bitmap::Recount()
+{
+    if (numBits % BitsInWord != 0)
+	map[numWords - 1] |= AllSet << (numBits % BitsInWord);
+    numClear = 0;
+    for (int i = 0; i < numWords; i++)
+	numClear += BitsInWord - CountOnes(map[i]);
+}
+
 //----------------------------------------------------------------------
 // Bitmap::Set
 // 	Set the "nth" bit in a bitmap.
@@ -55,9 +152,14 @@ Bitmap::~Bitmap()
 void
 Bitmap::Mark(int which) 
 { 
+    unsigned int bit = 1U << (which % BitsInWord);
+
     ASSERT(which >= 0 && which < numBits);
 
-    map[which / BitsInWord] |= 1 << (which % BitsInWord);
+    if (!(map[which / BitsInWord] & bit)) {
+	map[which / BitsInWord] |= bit;
+	numClear--;
+    }
 
     ASSERT(Test(which));
 }
@@ -72,9 +174,14 @@ Bitmap::Mark(int which)
 void 
 Bitmap::Clear(int which) 
 {
+    unsigned int bit = 1U << (which % BitsInWord);
+
     ASSERT(which >= 0 && which < numBits);
 
-    map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+    if (map[which / BitsInWord] & bit) {
+	map[which / BitsInWord] &= ~bit;
+	numClear++;
+    }
 
     ASSERT(!Test(which));
 }
@@ -91,32 +198,142 @@ Bitmap::Test(int which) const
 {
     ASSERT(which >= 0 && which < numBits);
     
-    if (map[which / BitsInWord] & (1 << (which % BitsInWord))) {
+    if (map[which / BitsInWord] & (1U << (which % BitsInWord))) {
 	return TRUE;
     } else {
 	return FALSE;
     }
 }
 
+//----------------------------------------------------------------------
+// Bitmap::NextClear
+// 	Return the number of the first clear bit at or after "from",
+//	and before "limit".  Return "limit" if there is none.
+//----------------------------------------------------------------------
+
+int
+Bitmap::NextClear(int from, int limit) const
+{
+    int w = from / BitsInWord;
+    unsigned int word;
+
+    if (from >= limit)
+	return limit;
+    word = ~map[w] & (AllSet << (from % BitsInWord));
+    while (word == 0) {
+	w = SkipFullWords(map, w + 1, numWords);
+	if (w * BitsInWord >= limit)
+	    return limit;
+	word = ~map[w];
+    }
+    return min(w * BitsInWord + CountTrailingZeros(word), limit);
+}
+
+//----------------------------------------------------------------------
+// Bitmap::NextSet
+// 	Return the number of the first set bit at or after "from",
+//	and before "limit".  Return "limit" if there is none.
+//----------------------------------------------------------------------
+
+int
+Bitmap::NextSet(int from, int limit) const
+{
+    int w = from / BitsInWord;
+    unsigned int word;
+
+    if (from >= limit)
+	return limit;
+    word = map[w] & (AllSet << (from % BitsInWord));
+    while (word == 0) {
+	if (++w * BitsInWord >= limit)
+	    return limit;
+	word = map[w];
+    }
+    return min(w * BitsInWord + CountTrailingZeros(word), limit);
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindRun
+// 	Return the number of the first bit of the first run of "numItems"
+//	consecutive clear bits lying in [from, limit), or -1 if there
+//	is none.
+//----------------------------------------------------------------------
+
+int
+Bitmap::FindRun(int numItems, int from, int limit) const
+{
+    int start = NextClear(from, limit);
+
+    while (start + numItems <= limit) {
+	int end = NextSet(start, start + numItems);
+
+	if (end == start + numItems)
+	    return start;
+	start = NextClear(end, limit);
+    }
+    return -1;
+}
+
 //----------------------------------------------------------------------
 // Bitmap::FindAndSet
-// 	Return the number of the first bit which is clear.
+// 	Return the number of a bit which is clear.
 //	As a side effect, set the bit (mark it as in use).
 //	(In other words, find and allocate a bit.)
 //
+//	The search starts where the last one left off ("next fit"), and
+//	wraps around to the start of the bitmap, so that bits given out
+//	one after another tend to be near each other.
+//
 //	If no bits are clear, return -1.
 //----------------------------------------------------------------------
 
 int 
 Bitmap::FindAndSet() 
 {
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    Mark(i);
-	    return i;
-	}
+    int i;
+
+    if (numClear == 0)
+	return -1;
+    i = NextClear(hint * BitsInWord, numBits);
+    if (i == numBits)
+	i = NextClear(0, numBits);
+    ASSERT(i < numBits);
+    Mark(i);
+    hint = i / BitsInWord;
+    return i;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindAndSetRun
+// 	Return the number of the first bit of a run of "numItems"
+//	consecutive clear bits.  As a side effect, set all the bits in
+//	the run.  As with FindAndSet, the search starts where the last 
+//	one left off.
+//
+//	If there is no run that long, return -1.
+//
+//	"numItems" is the length of the run wanted.
+//----------------------------------------------------------------------
+
+int 
+Bitmap::FindAndSetRun(int numItems) 
+{
+    int from = hint * BitsInWord;
+    int start;
+
+    ASSERT(numItems > 0);
+    if (numClear < numItems)
+	return -1;
+    start = FindRun(numItems, from, numBits);
+    if (start == -1)
+	start = FindRun(numItems, 0, min(from + numItems - 1, numBits));
+    if (start == -1)
+	return -1;
+    for (int j = start; j < start + numItems; j++) {
+	Mark(j);
     }
-    return -1;
+    hint = (start + numItems - 1) / BitsInWord;
+    return start;
 }
 
 //----------------------------------------------------------------------
@@ -128,14 +345,7 @@ Bitmap::FindAndSet()
 int 
 Bitmap::NumClear() const
 {
-    int count = 0;
-
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    count++;
-	}
-    }
-    return count;
+    return numClear;
 }
 
 //----------------------------------------------------------------------
@@ -188,4 +398,116 @@ Bitmap::SelfTest()
     for (i = 0; i < numBits; i++) {
         Clear(i);
     }
+
+    ASSERT(FindAndSetRun(BitsInWord + 3) == 0);
+    ASSERT(NumClear() == numBits - BitsInWord - 3);
+    Clear(5);				// a hole behind the last search...
+    ASSERT(FindAndSetRun(2) == BitsInWord + 3);
+    ASSERT(FindAndSet() == BitsInWord + 5);
+    for (i = BitsInWord + 6; i < numBits; i++) {
+        Mark(i);
+    }
+    ASSERT(FindAndSet() == 5);		// ...is found once we wrap around
+    ASSERT(NumClear() == 0);
+    ASSERT(FindAndSetRun(1) == -1);
+    for (i = 0; i < numBits; i++) {
+        Clear(i);
+    }
+    ASSERT(NumClear() == numBits);
+}
+
+//----------------------------------------------------------------------
+// Bitmap::Benchmark
+// 	Time the searches on this bitmap, which must be empty, against
+//	the same searches done one bit at a time with Test, and print
+//	the results.
+//
+//	The bitmap is filled except for its very last bits, so that each
+//	search has to look at the whole of it.
+//----------------------------------------------------------------------
+
+void
+Bitmap::Benchmark()
+{
+    const int numRounds = 20;
+    const int runLength = 8;
+    double start, slow, fast;
+    int i, j, count, runStart, found;
+
+    ASSERT(NumClear() == numBits && numBits > runLength);
+    for (i = 0; i < numBits - runLength; i++) {
+	Mark(i);
+    }
+
+    // FindAndSet: the first clear bit
+    start = HostTime();
+    for (j = 0; j < numRounds; j++) {
+	for (found = 0; found < numBits && Test(found); found++)
+	    ;
+	ASSERT(found == numBits - runLength);
+    }
+    slow = HostTime() - start;
+    start = HostTime();
+    for (j = 0; j < numRounds; j++) {
+	hint = 0;
+	found = FindAndSet();
+	ASSERT(found == numBits - runLength);
+	Clear(found);
+    }
+    fast = HostTime() - start;
+    cout << "Bitmap of " << numBits << " bits, times in microseconds:\n";
+    cout << "FindAndSet: bit at a time " << slow / numRounds
+	<< ", word at a time " << fast / numRounds << "\n";
+
+    // NumClear
+    start = HostTime();
+    for (j = 0; j < numRounds; j++) {
+	for (count = 0, i = 0; i < numBits; i++) {
+	    if (!Test(i)) {
+		count++;
+	    }
+	}
+	ASSERT(count == runLength);
+    }
+    slow = HostTime() - start;
+    start = HostTime();
+    for (j = 0; j < numRounds; j++) {
+	ASSERT(NumClear() == runLength);
+    }
+    fast = HostTime() - start;
+    cout << "NumClear: bit at a time " << slow / numRounds
+	<< ", word at a time " << fast / numRounds << "\n";
+
+    // FindAndSetRun: the first run of "runLength" clear bits
+    start = HostTime();
+    for (j = 0; j < numRounds; j++) {
+	for (found = -1, runStart = 0, count = 0, i = 0; i < numBits; i++) {
+	    if (Test(i)) {
+		runStart = i + 1;
+		count = 0;
+	    } else if (++count == runLength) {
+		found = runStart;
+		break;
+	    }
+	}
+	ASSERT(found == numBits - runLength);
+    }
+    slow = HostTime() - start;
+    start = HostTime();
+    for (j = 0; j < numRounds; j++) {
+	hint = 0;
+	found = FindAndSetRun(runLength);
+	ASSERT(found == numBits - runLength);
+	for (i = found; i < numBits; i++) {
+	    Clear(i);
+	}
+    }
+    fast = HostTime() - start;
+    cout << "FindAndSetRun(" << runLength << "): bit at a time " 
+	<< slow / numRounds << ", word at a time " << fast / numRounds << "\n";
+
+    for (i = 0; i < numBits; i++) {
+	Clear(i);
+    }
+    hint = 0;
 }
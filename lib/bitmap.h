@@ -4,6 +4,9 @@
 //
 //	Represented as an array of unsigned integers, on which we do
 //	modulo arithmetic to find the bit we are interested in.
+//	Searches look at a whole word at a time, skipping words that
+//	are entirely in use, and the number of clear bits is kept up
+//	to date as bits are set and cleared, so it need not be counted.
 //
 //	The bitmap can be parameterized with with the number of bits being 
 //	managed.
@@ -34,18 +37,24 @@ class Bitmap {
   public:
     Bitmap(int numItems);	// Initialize a bitmap, with "numItems" bits
 				// initially, all bits are cleared.
-    ~Bitmap();			// De-allocate bitmap
+    virtual ~Bitmap();		// De-allocate bitmap
     
-    void Mark(int which);   	// Set the "nth" bit
-    void Clear(int which);  	// Clear the "nth" bit
+    virtual void Mark(int which);   	// Set the "nth" bit
+    virtual void Clear(int which);  	// Clear the "nth" bit
     bool Test(int which) const;	// Is the "nth" bit set?
     int FindAndSet();         // Return the # of a clear bit, and as a side
 				// effect, set the bit. 
 				// If no bits are clear, return -1.
+    int FindAndSetRun(int numItems);
+				// Return the # of the first of "numItems"
+				// consecutive clear bits, and set them all.
+				// If there is no such run, return -1.
     int NumClear() const;	// Return the number of clear bits
 
     void Print() const;		// Print contents of bitmap
     void SelfTest();		// Test whether bitmap is working
+    void Benchmark();		// Time the searches, against testing
+				// one bit at a time
     
   protected:
     int numBits;		// number of bits in the bitmap
@@ -54,6 +63,22 @@ class Bitmap {
 				//  multiple of the number of bits in
 				//  a word)
     unsigned int *map;		// bit storage
+    int numClear;		// number of bits clear
+    int hint;			// word to start the next search at
+
+    void Recount();		// Recompute "numClear", after "map" has
+				// been changed behind our back
+
+  private:
+    int NextClear(int from, int limit) const;
+				// # of the first clear bit in [from, limit),
+				// or limit if there is none
+    int NextSet(int from, int limit) const;
+				// # of the first set bit in [from, limit),
+				// or limit if there is none
+    int FindRun(int numItems, int from, int limit) const;
+				// # of the first run of "numItems" clear
+				// bits in [from, limit), or -1
 };
 
 #endif // BITMAP_H
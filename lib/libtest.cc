@@ -83,3 +83,17 @@ LibSelfTest () {
     delete sortList;
     delete hashTable;
 }
+
+//----------------------------------------------------------------------
+// LibBenchmark
+//	Time the bitmap searches on a bitmap big enough (a million bits)
+//	for the difference to show.
+//----------------------------------------------------------------------
+
+void
+LibBenchmark () {
+    Bitmap *map = new Bitmap(1 << 20);
+
+    map->Benchmark();
+    delete map;
+}
@@ -51,9 +51,10 @@ extern "C" {
 #include <signal.h>
 #include <sys/types.h>
 
-#ifndef NO_MPROT 
 #include <sys/mman.h>
-#endif
+#include <sys/uio.h>
+#include <limits.h>
+#include <pthread.h>
 
 // UNIX routines called by procedures in this file 
 
@@ -149,6 +150,22 @@ UDelay(unsigned int useconds)
 
 }
 
+//----------------------------------------------------------------------
+// HostTime
+// 	Return the real (not simulated) time, in microseconds since
+//	some fixed point in the past.  Only useful for measuring how
+//	long Nachos itself takes to do something.
+//----------------------------------------------------------------------
+
+double 
+HostTime()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
@@ -379,6 +396,66 @@ Lseek(int fd, int offset, int whence)
     ASSERT(retVal >= 0);
 }
 
+//----------------------------------------------------------------------
+// ReadAt, WriteAt
+// 	Read/write characters at a given location within an open file,
+//	without moving the file position, in a single system call.  
+//	Abort if the read/write fails.
+//----------------------------------------------------------------------
+
+void
+ReadAt(int fd, char *buffer, int nBytes, int offset)
+{
+    int retVal = pread(fd, buffer, nBytes, offset);
+    ASSERT(retVal == nBytes);
+}
+
+void
+WriteAt(int fd, char *buffer, int nBytes, int offset)
+{
+    int retVal = pwrite(fd, buffer, nBytes, offset);
+    ASSERT(retVal == nBytes);
+}
+
+//----------------------------------------------------------------------
+// ReadVectorAt, WriteVectorAt
+// 	Read/write consecutive characters of an open file, starting at
+//	a given location, into/out of "count" separate buffers of "nBytes"
+//	each, in a single system call.  Abort if the read/write fails.
+//----------------------------------------------------------------------
+
+void
+ReadVectorAt(int fd, char **buffers, int nBytes, int count, int offset)
+{
+    struct iovec *iov = new struct iovec[count];
+    int retVal;
+
+    ASSERT(count <= IOV_MAX);
+    for (int i = 0; i < count; i++) {
+	iov[i].iov_base = buffers[i];
+	iov[i].iov_len = nBytes;
+    }
+    retVal = preadv(fd, iov, count, offset);
+    ASSERT(retVal == nBytes * count);
+    delete [] iov;
+}
+
+void
+WriteVectorAt(int fd, char **buffers, int nBytes, int count, int offset)
+{
+    struct iovec *iov = new struct iovec[count];
+    int retVal;
+
+    ASSERT(count <= IOV_MAX);
+    for (int i = 0; i < count; i++) {
+	iov[i].iov_base = buffers[i];
+	iov[i].iov_len = nBytes;
+    }
+    retVal = pwritev(fd, iov, count, offset);
+    ASSERT(retVal == nBytes * count);
+    delete [] iov;
+}
+
 //----------------------------------------------------------------------
 // Tell
 // 	Report the current location within an open file.
@@ -409,6 +486,135 @@ Close(int fd)
     return retVal;
 }
 
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "nBytes" of an open file into memory, shared with
+//	the file, so that storing into the memory changes the file.
+//	Return NULL if the file can't be mapped.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int nBytes)
+{
+    void *addr = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_SHARED, 
+				fd, 0);
+
+    if (addr == MAP_FAILED)
+	return NULL;
+    return (char *) addr;
+}
+
+//----------------------------------------------------------------------
+// SyncMappedFile
+// 	Write the changes made to a mapped file back to the file itself.
+//	Abort on error.
+//----------------------------------------------------------------------
+
+void
+SyncMappedFile(char *addr, int nBytes)
+{
+    int retVal = msync(addr, nBytes, MS_SYNC);
+    ASSERT(retVal >= 0);
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Undo MapFile.  Abort on error.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *addr, int nBytes)
+{
+    int retVal = munmap(addr, nBytes);
+    ASSERT(retVal >= 0);
+}
+
+//----------------------------------------------------------------------
+// StartHostThread
+// 	Start a host thread running "func(arg)", and return a handle to
+//	pass to JoinHostThread.  Abort on error.
+//----------------------------------------------------------------------
+
+class HostThreadStart {
+  public:
+    void (*func)(void *);		// What the thread runs
+    void *arg;				// ... and its argument
+};
+
+static void *
+HostThreadBody(void *start)
+{
+    HostThreadStart *s = (HostThreadStart *) start;
+
+    (*s->func)(s->arg);
+    delete s;
+    return NULL;
+}
+
+void *
+StartHostThread(void (*func)(void *), void *arg)
+{
+    pthread_t *thread = new pthread_t;
+    HostThreadStart *start = new HostThreadStart;
+    int retVal;
+
+    start->func = func;
+    start->arg = arg;
+    retVal = pthread_create(thread, NULL, HostThreadBody, start);
+    ASSERT(retVal == 0);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// JoinHostThread
+// 	Wait for a host thread started by StartHostThread to finish.
+//----------------------------------------------------------------------
+
+void
+JoinHostThread(void *thread)
+{
+    int retVal = pthread_join(*(pthread_t *) thread, NULL);
+
+    ASSERT(retVal == 0);
+    delete (pthread_t *) thread;
+}
+
+//----------------------------------------------------------------------
+// NumHostProcessors
+// 	Return the number of processors the host has online, at least 1.
+//----------------------------------------------------------------------
+
+int
+NumHostProcessors()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (count < 1) ? 1 : (int) count;
+}
+
+//----------------------------------------------------------------------
+// FetchAndAdd
+// 	Atomically add "amount" to "*counter", and return its old value.
+//----------------------------------------------------------------------
+
+int
+FetchAndAdd(int *counter, int amount)
+{
+    return __sync_fetch_and_add(counter, amount);
+}
+
+//----------------------------------------------------------------------
+// CompareAndSwap
+// 	Atomically set "*word" to "newValue" if it is "oldValue"; return
+//	TRUE if it was.
+//----------------------------------------------------------------------
+
+bool
+CompareAndSwap(int *word, int oldValue, int newValue)
+{
+    return __sync_bool_compare_and_swap(word, oldValue, newValue);
+}
+
 //----------------------------------------------------------------------
 // Unlink
 // 	Delete a file.
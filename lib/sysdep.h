@@ -25,6 +25,9 @@ extern void Exit(int exitCode);
 extern void Delay(int seconds);
 extern void UDelay(unsigned int usec);// rcgood - to avoid spinners.
 
+// Real time elapsed, in microseconds, for timing Nachos itself
+extern double HostTime();
+
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(void (*cleanup)(int));
 
@@ -49,10 +52,38 @@ extern void Read(int fd, char *buffer, int nBytes);
 extern int ReadPartial(int fd, char *buffer, int nBytes);
 extern void WriteFile(int fd, char *buffer, int nBytes);
 extern void Lseek(int fd, int offset, int whence);
+extern void ReadAt(int fd, char *buffer, int nBytes, int offset);
+extern void WriteAt(int fd, char *buffer, int nBytes, int offset);
+					// Read/write at "offset", leaving 
+					// the file position alone
+extern void ReadVectorAt(int fd, char **buffers, int nBytes, int count, 
+				int offset);
+extern void WriteVectorAt(int fd, char **buffers, int nBytes, int count, 
+				int offset);
+					// The same, for "count" separate
+					// buffers of "nBytes" each, holding
+					// consecutive bytes of the file
 extern int Tell(int fd);
 extern int Close(int fd);
 extern bool Unlink(char *name);
 
+// Map the first "nBytes" of an open file into memory, so that it can be
+// read and written in place; used to simulate the disk without a
+// system call per request.
+extern char *MapFile(int fd, int nBytes);
+extern void SyncMappedFile(char *addr, int nBytes);
+extern void UnmapFile(char *addr, int nBytes);
+
+// Real threads of the host, for work done outside the simulation, such
+// as checking a disk offline; Nachos threads are simulated, and never
+// run at the same time.  The counters are updated atomically, so that
+// host threads can share them without a lock.
+extern void *StartHostThread(void (*func)(void *), void *arg);
+extern void JoinHostThread(void *thread);
+extern int NumHostProcessors();
+extern int FetchAndAdd(int *counter, int amount);
+extern bool CompareAndSwap(int *word, int oldValue, int newValue);
+
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
 extern "C" {
@@ -19,27 +19,102 @@
 #include "sysdep.h"
 #include "main.h"
 
-// We put a magic number at the front of the UNIX file representing the
-// disk, to make it less likely we will accidentally treat a useful file 
-// as a disk (which would probably trash the file's contents).
+int SectorSize = DefaultSectorSize;
+int SectorsPerTrack = DefaultSectorsPerTrack;
+int NumTracks = DefaultNumTracks;
+int NumSectors = DefaultSectorsPerTrack * DefaultNumTracks;
 
-const int MagicNumber = 0x456789ab;
-const int MagicSize = sizeof(int);
-const int DiskSize = (MagicSize + (NumSectors * SectorSize));
+static bool newGeometry = FALSE;	// has SetDiskGeometry been called?
 
+//----------------------------------------------------------------------
+// DiskGeometryValid
+// 	Return TRUE if a disk could have the given geometry.  A sector
+//	must be big enough to hold a few words of file system structure,
+//	and the whole disk must be addressable in bytes by an int.
+//
+//	"sectorSize" -- number of bytes per sector; a power of 2
+//	"sectorsPerTrack" -- number of sectors per track
+//	"numTracks" -- number of tracks
+//----------------------------------------------------------------------
+
+bool
+DiskGeometryValid(int sectorSize, int sectorsPerTrack, int numTracks)
+{
+    return sectorSize >= 64 && (sectorSize & (sectorSize - 1)) == 0
+	&& sectorsPerTrack > 0 && numTracks > 0
+	&& (double) sectorSize * sectorsPerTrack * numTracks
+		< (double) 0x7fffffff - MagicSize;
+}
+
+//----------------------------------------------------------------------
+// SetDiskGeometry
+// 	Choose the geometry of the disk, if it is created from now on.
+//	If the disk already exists with a different geometry, it will
+//	be re-created, losing its contents, so this is only of use
+//	when the disk is about to be formatted.
+//
+//	"sectorSize" -- number of bytes per sector; a power of 2
+//	"sectorsPerTrack" -- number of sectors per track
+//	"numTracks" -- number of tracks
+//----------------------------------------------------------------------
+
+void
+SetDiskGeometry(int sectorSize, int sectorsPerTrack, int numTracks)
+{
+    ASSERT(DiskGeometryValid(sectorSize, sectorsPerTrack, numTracks));
+
+    SectorSize = sectorSize;
+    SectorsPerTrack = sectorsPerTrack;
+    NumTracks = numTracks;
+    NumSectors = sectorsPerTrack * numTracks;
+    newGeometry = TRUE;
+}
+
+
+//----------------------------------------------------------------------
+// LabelValid
+// 	Return TRUE if the front of an existing UNIX file is a disk label:
+//	the magic number, then a geometry that a disk could have, and
+//	that matches the length of the file.  A disk image written before
+//	the geometry was recorded holds sector 0 where the geometry
+//	would be, and fails this check.
+//
+//	"fileno" -- the UNIX file
+//	"label" -- the first MagicSize bytes of the file
+//----------------------------------------------------------------------
+
+static bool
+LabelValid(int fileno, int *label)
+{
+    if (label[0] != MagicNumber 
+		|| !DiskGeometryValid(label[1], label[2], label[3]))
+	return FALSE;
+    Lseek(fileno, 0, 2);
+    return Tell(fileno) == MagicSize + label[1] * label[2] * label[3];
+}
 
 //----------------------------------------------------------------------
 // Disk::Disk()
 // 	Initialize a simulated disk.  Open the UNIX file (creating it
-//	if it doesn't exist), and check the magic number to make sure it's 
-// 	ok to treat it as Nachos disk storage.
+//	if it doesn't exist), and check its label to make sure it's 
+// 	ok to treat it as Nachos disk storage.  The disk takes on the
+//	geometry recorded in the file, unless SetDiskGeometry has asked
+//	for a different one, in which case the file is re-created.
+//
+//	A file that is not labelled as a Nachos disk of this format is
+//	re-created too, with the default geometry, or whatever
+//	SetDiskGeometry asked for.
+//
+//	If the file can't be mapped into memory, we fall back to reading
+//	and writing it.
 //
 //	"toCall" -- object to call when disk read/write request completes
+//	"mapped" -- should the file be mapped into memory?
 //----------------------------------------------------------------------
 
-Disk::Disk(CallBackObj *toCall)
+Disk::Disk(CallBackObj *toCall, bool mapped)
 {
-    int magicNum;
+    int label[MagicSize / sizeof(int)];	// magic number, then geometry
     int tmp = 0;
 
     DEBUG(dbgDisk, "Initializing the disk.");
@@ -49,18 +124,39 @@ Disk::Disk(CallBackObj *toCall)
     
     sprintf(diskname,"DISK_%d",kernel->hostName);
     fileno = OpenForReadWrite(diskname, FALSE);
-    if (fileno >= 0) {		 	// file exists, check magic number 
-	Read(fileno, (char *) &magicNum, MagicSize);
-	ASSERT(magicNum == MagicNumber);
-    } else {				// file doesn't exist, create it
+    if (fileno >= 0) {		 	// file exists, check its label
+	Read(fileno, (char *) label, MagicSize);
+	if (!LabelValid(fileno, label)) {
+	    cerr << diskname << " is not a Nachos disk of this format, "
+			<< "creating it afresh\n";
+	    Close(fileno);		// old or foreign file, start over
+	    fileno = -1;
+	} else if (!newGeometry)	// take on the disk's geometry
+	    SetDiskGeometry(label[1], label[2], label[3]);
+	else if (label[1] != SectorSize || label[2] != SectorsPerTrack 
+		|| label[3] != NumTracks) {
+	    Close(fileno);		// wrong geometry, start over
+	    fileno = -1;
+	}
+    }
+    if (fileno < 0) {			// file doesn't exist, create it
         fileno = OpenForWrite(diskname);
-	magicNum = MagicNumber;  
-	WriteFile(fileno, (char *) &magicNum, MagicSize); // write magic number
+	label[0] = MagicNumber;  
+	label[1] = SectorSize;
+	label[2] = SectorsPerTrack;
+	label[3] = NumTracks;
+	WriteFile(fileno, (char *) label, MagicSize); // write magic number
 
 	// need to write at end of file, so that reads will not return EOF
-        Lseek(fileno, DiskSize - sizeof(int), 0);	
+        Lseek(fileno, MagicSize + NumSectors * SectorSize - sizeof(int), 0);	
 	WriteFile(fileno, (char *)&tmp, sizeof(int));  
     }
+    DEBUG(dbgDisk, "Disk has " << NumTracks << " tracks of " 
+		<< SectorsPerTrack << " sectors of " << SectorSize << " bytes");
+    mapSize = MagicSize + NumSectors * SectorSize;
+    mapping = mapped ? MapFile(fileno, mapSize) : NULL;
+    if (mapped && mapping == NULL)
+	cerr << "Couldn't map " << diskname << ", reading it instead\n";
     active = FALSE;
 }
 
@@ -72,9 +168,27 @@ Disk::Disk(CallBackObj *toCall)
 
 Disk::~Disk()
 {
+    if (mapping != NULL) {
+	SyncMappedFile(mapping, mapSize);
+	UnmapFile(mapping, mapSize);
+    }
     Close(fileno);
 }
 
+//----------------------------------------------------------------------
+// Disk::Flush()
+// 	Make sure every sector written so far is in the UNIX file.  When
+//	the file is mapped, what has been written so far may only be in
+//	memory.  Takes no simulated time.
+//----------------------------------------------------------------------
+
+void
+Disk::Flush()
+{
+    if (mapping != NULL)
+	SyncMappedFile(mapping, mapSize);
+}
+
 //----------------------------------------------------------------------
 // Disk::PrintSector()
 // 	Dump the data in a disk read/write request, for debugging.
@@ -97,56 +211,122 @@ PrintSector (bool writing, int sector, char *data)
 
 //----------------------------------------------------------------------
 // Disk::ReadRequest/WriteRequest
-// 	Simulate a request to read/write a single disk sector
+// 	Simulate a request to read/write a run of consecutive disk sectors
 //	   Do the read/write immediately to the UNIX file
 //	   Set up an interrupt handler to be called later,
 //	      that will notify the caller when the simulator says
 //	      the operation has completed.
 //
 //	Note that a disk only allows an entire sector to be read/written,
-//	not part of a sector.
+//	not part of a sector.  A run may not cross a track boundary --
+//	the disk would have to seek in the middle of the transfer.
+//
+//	The run is transferred to or from the UNIX file with a single
+//	positional read or write.  The sectors may either be together
+//	in one buffer, or each in a buffer of its own ("sectors"), in 
+//	which case they are gathered or scattered by the same call.
 //
-//	"sectorNumber" -- the disk sector to read/write
+//	"sectorNumber" -- the first disk sector to read/write
 //	"data" -- the bytes to be written, the buffer to hold the incoming bytes
+//	"sectors" -- one such buffer per sector
+//	"numSectors" -- the number of consecutive sectors to transfer
 //----------------------------------------------------------------------
 
 void
-Disk::ReadRequest(int sectorNumber, char* data)
+Disk::ReadRequest(int sectorNumber, char* data, int numSectors)
 {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+    int offset = SectorSize * sectorNumber + MagicSize;
 
-    ASSERT(!active);				// only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
-    
-    DEBUG(dbgDisk, "Reading from sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
+    StartRequest(sectorNumber, numSectors, FALSE);
+    DEBUG(dbgDisk, "Reading " << numSectors << " sectors from sector " << sectorNumber);
+    if (mapping != NULL)
+	bcopy(&mapping[offset], data, SectorSize * numSectors);
+    else
+	ReadAt(fileno, data, SectorSize * numSectors, offset);
     if (debug->IsEnabled('d'))
-	PrintSector(FALSE, sectorNumber, data);
-    
-    active = TRUE;
-    UpdateLast(sectorNumber);
-    kernel->stats->numDiskReads++;
-    kernel->interrupt->Schedule(this, ticks, DiskInt);
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(FALSE, sectorNumber + i, &data[i * SectorSize]);
 }
 
 void
-Disk::WriteRequest(int sectorNumber, char* data)
+Disk::ReadRequest(int sectorNumber, char** sectors, int numSectors)
 {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+    int offset = SectorSize * sectorNumber + MagicSize;
+
+    StartRequest(sectorNumber, numSectors, FALSE);
+    DEBUG(dbgDisk, "Reading " << numSectors << " sectors from sector " << sectorNumber);
+    if (mapping != NULL) {
+	for (int i = 0; i < numSectors; i++)
+	    bcopy(&mapping[offset + i * SectorSize], sectors[i], SectorSize);
+    } else
+	ReadVectorAt(fileno, sectors, SectorSize, numSectors, offset);
+    if (debug->IsEnabled('d'))
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(FALSE, sectorNumber + i, sectors[i]);
+}
 
-    ASSERT(!active);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
-    
-    DEBUG(dbgDisk, "Writing to sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
+void
+Disk::WriteRequest(int sectorNumber, char* data, int numSectors)
+{
+    int offset = SectorSize * sectorNumber + MagicSize;
+
+    StartRequest(sectorNumber, numSectors, TRUE);
+    DEBUG(dbgDisk, "Writing " << numSectors << " sectors to sector " << sectorNumber);
+    if (mapping != NULL)
+	bcopy(data, &mapping[offset], SectorSize * numSectors);
+    else
+	WriteAt(fileno, data, SectorSize * numSectors, offset);
     if (debug->IsEnabled('d'))
-	PrintSector(TRUE, sectorNumber, data);
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(TRUE, sectorNumber + i, &data[i * SectorSize]);
+}
+
+void
+Disk::WriteRequest(int sectorNumber, char** sectors, int numSectors)
+{
+    int offset = SectorSize * sectorNumber + MagicSize;
+
+    StartRequest(sectorNumber, numSectors, TRUE);
+    DEBUG(dbgDisk, "Writing " << numSectors << " sectors to sector " << sectorNumber);
+    if (mapping != NULL) {
+	for (int i = 0; i < numSectors; i++)
+	    bcopy(sectors[i], &mapping[offset + i * SectorSize], SectorSize);
+    } else
+	WriteVectorAt(fileno, sectors, SectorSize, numSectors, offset);
+    if (debug->IsEnabled('d'))
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(TRUE, sectorNumber + i, sectors[i]);
+}
+
+//----------------------------------------------------------------------
+// Disk::StartRequest
+// 	Check a request, work out how long the disk will take to do it,
+//	and schedule the interrupt that signals it is done.  The caller
+//	then does the transfer; it takes no simulated time.
+//
+//	"sectorNumber" -- the first disk sector to read/write
+//	"numSectors" -- the number of consecutive sectors to transfer
+//	"writing" -- is it a write?
+//----------------------------------------------------------------------
+
+void
+Disk::StartRequest(int sectorNumber, int numSectors, bool writing)
+{
+    int ticks = ComputeLatency(sectorNumber, numSectors, writing);
+    int lastSector = sectorNumber + numSectors - 1;
+
+    ASSERT(!active);				// only one request at a time
+    ASSERT((sectorNumber >= 0) && (lastSector < NumSectors));
+    ASSERT(sectorNumber / SectorsPerTrack == lastSector / SectorsPerTrack);
     
     active = TRUE;
     UpdateLast(sectorNumber);
-    kernel->stats->numDiskWrites++;
+    this->lastSector = lastSector;	// same track, so the track
+					// buffer is unaffected
+    if (writing)
+	kernel->stats->numDiskWrites++;
+    else
+	kernel->stats->numDiskReads++;
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
 
@@ -249,6 +429,21 @@ Disk::ComputeLatency(int newSector, bool writing)
     return(seek + rotation + RotationTime);
 }
 
+//----------------------------------------------------------------------
+// Disk::ComputeLatency()
+// 	Return how long will it take to read/write a run of consecutive
+//	sectors on one track.  We pay for the seek and rotational delay
+//	to the first sector only; after that, each following sector
+//	passes under the head in turn.
+//----------------------------------------------------------------------
+
+int
+Disk::ComputeLatency(int newSector, int numSectors, bool writing)
+{
+    return ComputeLatency(newSector, writing) 
+		+ (numSectors - 1) * RotationTime;
+}
+
 //----------------------------------------------------------------------
 // Disk::UpdateLast
 //   	Keep track of the most recently requested sector.  So we can know
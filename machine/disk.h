@@ -46,44 +46,100 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// The UNIX file can also be mapped into memory, so that a request is
+// just a copy to or from the mapping, rather than a seek and a read or
+// write system call.  This only makes the simulator itself faster; the
+// simulated time each request takes is the same either way.
+
+//
+// The geometry of the disk -- the size of a sector, and the number of
+// sectors and tracks -- is chosen when the disk is created, and
+// recorded at the front of the UNIX file, along with the magic number.
+// Once the disk has been created, the globals below hold its geometry;
+// until then, they hold the geometry a new disk will be given, which
+// may be changed by calling SetDiskGeometry.
+
+extern int SectorSize;			// number of bytes per disk sector
+extern int SectorsPerTrack;		// number of sectors per disk track 
+extern int NumTracks;			// number of tracks per disk
+extern int NumSectors;			// total # of sectors per disk
 
-const int SectorSize = 128;		// number of bytes per disk sector
-const int SectorsPerTrack  = 32;	// number of sectors per disk track 
-const int NumTracks = 32;		// number of tracks per disk
-const int NumSectors = (SectorsPerTrack * NumTracks);
-					// total # of sectors per disk
+const int DefaultSectorSize = 128;	// geometry of a disk, unless 
+const int DefaultSectorsPerTrack = 32;	// SetDiskGeometry is called
+const int DefaultNumTracks = 32;
+
+// We put a magic number at the front of the UNIX file representing the
+// disk, to make it less likely we will accidentally treat a useful file 
+// as a disk (which would probably trash the file's contents).  The
+// geometry of the disk follows the magic number, and sector i starts
+// MagicSize + i * SectorSize bytes into the file.
+
+const int MagicNumber = 0x456789ab;
+const int MagicSize = 4 * sizeof(int);	// magic number, and the geometry
+
+extern bool DiskGeometryValid(int sectorSize, int sectorsPerTrack,
+				int numTracks);
+					// Could a disk have this geometry?
+extern void SetDiskGeometry(int sectorSize, int sectorsPerTrack, 
+				int numTracks);
+					// Geometry to give the disk, if it
+					// is created or re-created (formatted)
+					// from now on
 
 class Disk : public CallBackObj {
   public:
-    Disk(CallBackObj *toCall);          // Create a simulated disk.  
+    Disk(CallBackObj *toCall, bool mapped = FALSE);
+					// Create a simulated disk.  
 					// Invoke toCall->CallBack() 
 					// when each request completes.
+					// If "mapped", map the UNIX file
+					// into memory.
     ~Disk();				// Deallocate the disk.
     
-    void ReadRequest(int sectorNumber, char* data);
-    					// Read/write an single disk sector.
+    void ReadRequest(int sectorNumber, char* data, int numSectors = 1);
+    					// Read/write "numSectors" consecutive
+					// disk sectors, all on the same track
+					// (by default, a single sector).
 					// These routines send a request to 
     					// the disk and return immediately.
     					// Only one request allowed at a time!
-    void WriteRequest(int sectorNumber, char* data);
+    void WriteRequest(int sectorNumber, char* data, int numSectors = 1);
+    void ReadRequest(int sectorNumber, char** sectors, int numSectors);
+    void WriteRequest(int sectorNumber, char** sectors, int numSectors);
+					// The same, but each sector has
+					// a buffer of its own
 
     void CallBack();			// Invoked when disk request 
 					// finishes. In turn calls, callWhenDone.
 
+    void Flush();			// Make sure everything written so
+					// far has reached the UNIX file
+
     int ComputeLatency(int newSector, bool writing);	
     					// Return how long a request to 
 					// newSector will take: 
 					// (seek + rotational delay + transfer)
+    int ComputeLatency(int newSector, int numSectors, bool writing);
+					// The same, for a run of sectors: 
+					// seek and rotate once, then
+					// transfer each sector in turn
 
   private:
     int fileno;				// UNIX file number for simulated disk 
     char diskname[32];			// name of simulated disk's file
+    char *mapping;			// The UNIX file mapped into memory,
+					// or NULL if it is read and written
+    int mapSize;			// Number of bytes mapped
     CallBackObj *callWhenDone;		// Invoke when any disk request finishes
     bool active;     			// Is a disk operation in progress?
     int lastSector;			// The previous disk request 
     int bufferInit;			// When the track buffer started 
 					// being loaded
 
+    void StartRequest(int sectorNumber, int numSectors, bool writing);
+					// Schedule the completion of a
+					// request
     int TimeToSeek(int newSector, int *rotate); // time to get to the new track
     int ModuloDiff(int to, int from);        // # sectors between to and from
     void UpdateLast(int newSector);
@@ -242,8 +242,6 @@ Interrupt::Halt()
     cout << "This is halt\n";
     kernel->stats->Print();
 	*/
-	delete debug;
-	
     delete kernel;	// Never returns.
 }
 
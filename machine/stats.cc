@@ -20,6 +20,10 @@ Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
     numDiskReads = numDiskWrites = 0;
+    diskSeekTracks = diskRequestTicks = 0;
+    numCacheHits = numCacheMisses = numCacheEvictions = 0;
+    numPrefetched = numPrefetchHits = numPrefetchWasted = 0;
+    numJournalOps = numJournalCommits = numJournalSectors = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
 }
@@ -36,7 +40,18 @@ Statistics::Print()
     cout << "Ticks: total " << totalTicks << ", idle " << idleTicks;
 		cout << ", system " << systemTicks << ", user " << userTicks <<"\n";
     cout << "Disk I/O: reads " << numDiskReads;
-		cout << ", writes " << numDiskWrites << "\n";
+		cout << ", writes " << numDiskWrites;
+		cout << ", tracks seeked " << diskSeekTracks;
+		cout << ", request ticks " << diskRequestTicks << "\n";
+    cout << "Block cache: hits " << numCacheHits;
+		cout << ", misses " << numCacheMisses;
+		cout << ", evictions " << numCacheEvictions << "\n";
+    cout << "Read-ahead: sectors " << numPrefetched;
+		cout << ", hits " << numPrefetchHits;
+		cout << ", wasted " << numPrefetchWasted << "\n";
+    cout << "Journal: operations " << numJournalOps;
+		cout << ", commits " << numJournalCommits;
+		cout << ", sectors " << numJournalSectors << "\n";
 		cout << "Console I/O: reads " << numConsoleCharsRead;
     cout << ", writes " << numConsoleCharsWritten << "\n";
     cout << "Paging: faults " << numPageFaults << "\n";
@@ -30,6 +30,21 @@ class Statistics {
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int diskSeekTracks;		// total number of tracks the disk head
+				// has moved across
+    int diskRequestTicks;	// total time disk requests spent queued
+				// or being served
+    int numCacheHits;		// number of block cache hits
+    int numCacheMisses;		// number of block cache misses
+    int numCacheEvictions;	// number of frames evicted from the
+				// block cache
+    int numPrefetched;		// number of sectors read ahead
+    int numPrefetchHits;	// number of read-ahead sectors later read
+    int numPrefetchWasted;	// number of read-ahead sectors evicted
+				// without being read
+    int numJournalOps;		// number of file system operations logged
+    int numJournalCommits;	// number of transactions committed
+    int numJournalSectors;	// number of sectors written to the journal
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
@@ -0,0 +1,6 @@
+cp DISK_0 DISK_0.old
+../build.linux/nachos -f
+../build.linux/nachos -cp FS_test1 /FS_test1
+../build.linux/nachos -e /FS_test1
+../build.linux/nachos -fsck
+mv DISK_0.old DISK_0
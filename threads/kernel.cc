@@ -15,6 +15,9 @@
 #include "libtest.h"
 #include "string.h"
 #include "synchdisk.h"
+#include "blockcache.h"
+#include "inode.h"
+#include "fdtable.h"
 #include "post.h"
 #include "synchconsole.h"
 
@@ -30,11 +33,16 @@ Kernel::Kernel(int argc, char **argv)
     debugUserProg = FALSE;
     consoleIn = NULL;          // default is stdin
     consoleOut = NULL;         // default is stdout
+    diskPolicy = NULL;		// default is first come, first served
+    diskMapped = FALSE;		// default is to read and write the disk
 #ifndef FILESYS_STUB
     formatFlag = FALSE;
+    geomSectorSize = 0;		// default is the geometry of the
+				// existing disk, if there is one
 #endif
     reliability = 1;            // network reliability, default is 1.0
     hostName = 0;               // machine id, also UNIX socket name
+    exitStatus = 0;		// success, unless a command fails
                                 // 0 is the default machine id
 								
 	// MP4 mod tag
@@ -60,9 +68,21 @@ Kernel::Kernel(int argc, char **argv)
 	    	ASSERT(i + 1 < argc);
 	    	consoleOut = argv[i + 1];
 	    	i++;
+		} else if (strcmp(argv[i], "-ds") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	diskPolicy = argv[i + 1];
+	    	i++;
+		} else if (strcmp(argv[i], "-dm") == 0) {
+	    	diskMapped = TRUE;
 #ifndef FILESYS_STUB
 		} else if (strcmp(argv[i], "-f") == 0) {
 	    	formatFlag = TRUE;
+		} else if (strcmp(argv[i], "-geom") == 0) {
+	    	ASSERT(i + 3 < argc);
+	    	geomSectorSize = atoi(argv[i + 1]);
+	    	geomSectorsPerTrack = atoi(argv[i + 2]);
+	    	geomNumTracks = atoi(argv[i + 3]);
+	    	i += 3;
 #endif
         } else if (strcmp(argv[i], "-n") == 0) {
             ASSERT(i + 1 < argc);   // next argument is float
@@ -76,8 +96,10 @@ Kernel::Kernel(int argc, char **argv)
             cout << "Partial usage: nachos [-rs randomSeed]\n";
 	   		cout << "Partial usage: nachos [-s]\n";
             cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut]\n";
+            cout << "Partial usage: nachos [-ds fcfs|sstf|scan|clook] [-dm]\n";
 #ifndef FILESYS_STUB
 	    	cout << "Partial usage: nachos [-nf]\n";
+	    	cout << "Partial usage: nachos [-f -geom sectorSize sectorsPerTrack tracks]\n";
 #endif
             cout << "Partial usage: nachos [-n #] [-m #]\n";
 		}
@@ -109,12 +131,26 @@ Kernel::Initialize()
     machine = new Machine(debugUserProg);
     synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
-    synchDisk = new SynchDisk();    //
+#ifndef FILESYS_STUB
+    if (formatFlag) {		// only a new file system can change it
+	if (geomSectorSize != 0)
+	    SetDiskGeometry(geomSectorSize, geomSectorsPerTrack, 
+				geomNumTracks);
+	else
+	    SetDiskGeometry(DefaultSectorSize, DefaultSectorsPerTrack,
+				DefaultNumTracks);
+    } else if (geomSectorSize != 0)
+	cerr << "-geom ignored, the disk is not being formatted\n";
+#endif
+    synchDisk = new SynchDisk(diskPolicy, diskMapped);
+    blockCache = new BlockCache(synchDisk, NumCacheFrames);
+    inodeTable = new InodeTable();
 #ifdef FILESYS_STUB
     fileSystem = new FileSystem();
 #else
     fileSystem = new FileSystem(formatFlag);
 #endif // FILESYS_STUB
+    openFileTable = new OpenFileTable();
 
 	// MP4 mod tag
     /*
@@ -146,6 +182,13 @@ Kernel::PrepareToEnd()
 
 Kernel::~Kernel()
 {
+    delete openFileTable;	// close what user programs left open,
+    delete fileSystem;		// then the file system, while the disk
+				// can still be used to flush it
+    delete inodeTable;
+    delete blockCache;
+    if (diskPolicy != NULL)	// asked for a policy, so report on it
+	synchDisk->PrintStats();
     delete stats;
     delete interrupt;
     delete scheduler;
@@ -154,7 +197,6 @@ Kernel::~Kernel()
     delete synchConsoleIn;
     delete synchConsoleOut;
     delete synchDisk;
-    delete fileSystem;
 	
 	// Mp4 mod tag
 	/*
@@ -162,12 +204,14 @@ Kernel::~Kernel()
     delete postOfficeOut;
     */
 	
-    Exit(0);
+    delete debug;
+    Exit(exitStatus);
 }
 
 //----------------------------------------------------------------------
 // Kernel::ThreadSelfTest
-//      Test threads, semaphores, synchlists
+//      Test threads, semaphores, synchlists, and the sharing of files
+//	opened by user programs
 //----------------------------------------------------------------------
 
 void
@@ -190,6 +234,9 @@ Kernel::ThreadSelfTest() {
    synchList->SelfTest(9);
    delete synchList;
 
+#ifndef FILESYS_STUB
+   OpenFileTable::SelfTest();	// test sharing open files
+#endif // FILESYS_STUB
 }
 
 //----------------------------------------------------------------------
@@ -335,26 +382,44 @@ int Kernel::CreateFile(char *filename,int initialSize)
 	return fileSystem->Create(filename,initialSize);
 }
 
+//----------------------------------------------------------------------
+// Kernel::Open, Kernel::Write, Kernel::Read, Kernel::Close
+//	The file system calls of the user program running in the current
+//	thread.  A file opened is given a descriptor in the program's own
+//	table (cf. fdtable.h), which the other calls look up.  Each returns
+//	-1 if the file can't be opened, or the descriptor is not open.
+//----------------------------------------------------------------------
+
 int Kernel::Open(char *filename) 
 {
-    int fileID = (int)fileSystem->Open(filename);
-    if(fileID!=0) return fileID;
-    return -1; 
+    OpenFile *file = fileSystem->Open(filename);
+
+    if (file == NULL)
+	return -1;
+    return currentThread->space->OpenFiles()->Open(file);
 }
 
 int Kernel::Write(char *buffer, int size, int id) 
 {
-    return fileSystem->Write(buffer, size, id); 
+    OpenFile *file = currentThread->space->OpenFiles()->Lookup(id);
+
+    if (file == NULL)
+	return -1;
+    return file->Write(buffer, size); 
 }
 
 int Kernel::Read(char *buffer, int size, int id) 
 {
-    return fileSystem->Read(buffer, size, id); 
+    OpenFile *file = currentThread->space->OpenFiles()->Lookup(id);
+
+    if (file == NULL)
+	return -1;
+    return file->Read(buffer, size); 
 }
 
 int Kernel::Close(int id) 
 {
-    return fileSystem->Close(id); 
+    return currentThread->space->OpenFiles()->Close(id) ? 1 : -1; 
 }
 
 //#endif
@@ -24,6 +24,9 @@ class PostOfficeOutput;
 class SynchConsoleInput;
 class SynchConsoleOutput;
 class SynchDisk;
+class BlockCache;
+class InodeTable;
+class OpenFileTable;
 
 
 
@@ -68,11 +71,16 @@ class Kernel {
     SynchConsoleInput *synchConsoleIn;
     SynchConsoleOutput *synchConsoleOut;
     SynchDisk *synchDisk;
+    BlockCache *blockCache;	// cache of disk sectors used by the
+				// file system
+    InodeTable *inodeTable;	// file headers of the open files
     FileSystem *fileSystem;     
+    OpenFileTable *openFileTable;	// files opened by user programs
     PostOfficeInput *postOfficeIn;
     PostOfficeOutput *postOfficeOut;
 
     int hostName;               // machine identifier
+    int exitStatus;		// what Nachos exits with when it halts
 
   private:
 
@@ -85,8 +93,14 @@ class Kernel {
     double reliability;         // likelihood messages are dropped
     char *consoleIn;            // file to read console input from
     char *consoleOut;           // file to send console output to
+    char *diskPolicy;		// disk scheduling policy, NULL for
+				// the default
+    bool diskMapped;		// map the disk's UNIX file into memory?
 #ifndef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
+    int geomSectorSize;		// geometry to format the disk with,
+    int geomSectorsPerTrack;	// if geomSectorSize is not 0
+    int geomNumTracks;
 #endif
 };
 
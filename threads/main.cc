@@ -4,8 +4,9 @@
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
 //              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
-//              -f -cp <unix file> <nachos file>
-//              -p <nachos file> -r <nachos file> -l -D
+//              -f -geom <sector size> <sectors per track> <tracks>
+//              -cp <unix file> <nachos file> -cpout <nachos file> <unix file>
+//              -p <nachos file> -r <nachos file> -l -D -fsck
 //              -n <network reliability> -m <machine id>
 //              -z -K -C -N
 //
@@ -24,11 +25,15 @@
 //
 //    Filesystem-related flags:
 //    -f forces the Nachos disk to be formatted
+//    -geom sets the geometry of the disk being formatted
 //    -cp copies a file from UNIX to Nachos
+//    -cpout copies a file from Nachos to UNIX
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system 
+//    -fsck checks the Nachos disk offline, without booting, and prints
+//	a report (see filesys/fsck.h); exits with 1 if anything is wrong
 //
 //  Note: the file system flags are not used if the stub filesystem
 //        is being used
@@ -44,7 +49,12 @@
 #include "main.h"
 #include "filesys.h"
 #include "openfile.h"
+#include "filehdr.h"
 #include "sysdep.h"
+#include "libtest.h"
+#ifndef FILESYS_STUB
+#include "fsck.h"
+#endif
 
 // global variables
 Kernel *kernel;
@@ -70,47 +80,128 @@ Cleanup(int x)
 //-------------------------------------------------------------------
 static const int TransferSize = 128;
 
+//-------------------------------------------------------------------
+// Constant used by "Copy" and "CopyOut"
+//   It is the number of bytes moved between the UNIX file and the
+//   Nachos file at a time.  It is a whole number of sectors, for any
+//   sector size, so every chunk but the last is written to the Nachos
+//   file as full sectors, without reading any of them in first.
+//-------------------------------------------------------------------
+static const int CopyBufferSize = 64 * 1024;
+
 
 #ifndef FILESYS_STUB
 //----------------------------------------------------------------------
 // Copy
 //      Copy the contents of the UNIX file "from" to the Nachos file "to"
+//
+//	The Nachos file is created empty, and the data is written to it
+//	CopyBufferSize bytes at a time, until the UNIX file runs out.
+//	Each chunk goes to the disk as a few multi-sector requests.
+//
+//	If the UNIX file is a regular file, the Nachos file is first
+//	given the sectors for all of it, in as few runs as the free space
+//	allows, so that the chunks are written into place rather than
+//	allocated one at a time.  A file small enough to be kept in its
+//	header is not given sectors.  If the length of the UNIX file
+//	cannot be found, the Nachos file grows as it is written.
+//
+//	Return FALSE if the copy fails.  If the Nachos disk fills up, the
+//	part of the file copied so far is removed again, so that it is
+//	not mistaken for the whole file.
 //----------------------------------------------------------------------
 
-static void
+static bool
 Copy(char *from, char *to)
 {
     int fd;
     OpenFile* openFile;
-    int amountRead, fileLength;
+    int amount, length, copied = 0;
     char *buffer;
+    bool success = TRUE;
 
 // Open UNIX file
     if ((fd = OpenForReadWrite(from,FALSE)) < 0) {       
         printf("Copy: couldn't open input file %s\n", from);
-        return;
+        return FALSE;
     }
 
-// Figure out length of UNIX file
-    Lseek(fd, 0, 2);            
-    fileLength = Tell(fd);
-    Lseek(fd, 0, 0);
-
-// Create a Nachos file of the same length
-    DEBUG('f', "Copying file " << from << " of size " << fileLength <<  " to file " << to);
-    if (!kernel->fileSystem->Create(to, fileLength)) {   // Create Nachos file
+// Create an empty Nachos file
+    DEBUG('f', "Copying file " << from << " to file " << to);
+    if (!kernel->fileSystem->Create(to, 0)) {   // Create Nachos file
         printf("Copy: couldn't create output file %s\n", to);
         Close(fd);
-        return;
+        return FALSE;
     }
     
     openFile = kernel->fileSystem->Open(to);
     ASSERT(openFile != NULL);
+
+// Preallocate the sectors for a UNIX file of known length
+    if (Tell(fd) >= 0) {
+        Lseek(fd, 0, 2);
+        length = Tell(fd);
+        Lseek(fd, 0, 0);
+        if (length > MaxHeaderData 
+                && !kernel->fileSystem->Resize(openFile, length)) {
+            printf("Copy: out of space for output file %s\n", to);
+            success = FALSE;
+        }
+    }
     
-// Copy the data in TransferSize chunks
-    buffer = new char[TransferSize];
-    while ((amountRead=ReadPartial(fd, buffer, sizeof(char)*TransferSize)) > 0)
-        openFile->Write(buffer, amountRead);    
+// Copy the data in CopyBufferSize chunks
+    buffer = new char[CopyBufferSize];
+    while (success && (amount = ReadPartial(fd, buffer, CopyBufferSize)) > 0) {
+        if (openFile->Write(buffer, amount) < amount) {
+            printf("Copy: out of space for output file %s\n", to);
+            success = FALSE;
+        }
+        copied += amount;
+    }
+    delete [] buffer;
+    if (success && copied < openFile->Length())	// UNIX file shrank
+        kernel->fileSystem->Resize(openFile, copied);
+
+// Close the UNIX and the Nachos files, and drop a partial copy
+    delete openFile;
+    Close(fd);
+    if (!success)
+        kernel->fileSystem->Remove(to);
+    return success;
+}
+
+//----------------------------------------------------------------------
+// CopyOut
+//      Copy the contents of the Nachos file "from" to the UNIX file "to",
+//	CopyBufferSize bytes at a time.
+//----------------------------------------------------------------------
+
+static void
+CopyOut(char *from, char *to)
+{
+    int fd;
+    OpenFile* openFile;
+    int amount, position, fileLength;
+    char *buffer;
+
+// Open the Nachos file
+    if ((openFile = kernel->fileSystem->Open(from)) == NULL) {
+        printf("CopyOut: couldn't open input file %s\n", from);
+        return;
+    }
+
+// Create the UNIX file, empty
+    fd = OpenForWrite(to);
+
+// Copy the data in CopyBufferSize chunks
+    fileLength = openFile->Length();
+    DEBUG('f', "Copying file " << from << " of size " << fileLength <<  " to file " << to);
+    buffer = new char[CopyBufferSize];
+    for (position = 0; position < fileLength; position += amount) {
+        amount = openFile->ReadAt(buffer, CopyBufferSize, position);
+        ASSERT(amount > 0);
+        WriteAt(fd, buffer, amount, position);
+    }
     delete [] buffer;
 
 // Close the UNIX and the Nachos files
@@ -129,7 +220,7 @@ void
 Print(char *name)
 {
     OpenFile *openFile;    
-    int i, amountRead;
+    int amountRead;
     char *buffer;
 
     if ((openFile = kernel->fileSystem->Open(name)) == NULL) {
@@ -137,10 +228,12 @@ Print(char *name)
         return;
     }
     
+    // write each chunk to stdout whole, after anything already 
+    // buffered there
+    fflush(stdout);
     buffer = new char[TransferSize];
     while ((amountRead = openFile->Read(buffer, TransferSize)) > 0)
-        for (i = 0; i < amountRead; i++)
-            printf("%c", buffer[i]);
+        WriteFile(1, buffer, amountRead);
     delete [] buffer;
 
     delete openFile;            // close the Nachos file
@@ -155,7 +248,9 @@ Print(char *name)
 static void
 CreateDirectory(char *name)
 {
-	// MP4 Assignment
+    if (!kernel->fileSystem->CreateDirectory(name)) {
+	printf("Mkdir: couldn't create directory %s\n", name);
+    }
 }
 
 //----------------------------------------------------------------------
@@ -181,13 +276,17 @@ main(int argc, char **argv)
     bool threadTestFlag = false;
     bool consoleTestFlag = false;
     bool networkTestFlag = false;
+    bool benchmarkFlag = false;
 #ifndef FILESYS_STUB
     char *copyUnixFileName = NULL;    // UNIX file to be copied into Nachos
     char *copyNachosFileName = NULL;  // name of copied file in Nachos
+    char *copyOutNachosFileName = NULL;	// Nachos file to be copied out
+    char *copyOutUnixFileName = NULL;	// name of copied file in UNIX
     char *printFileName = NULL; 
     char *removeFileName = NULL;
     bool dirListFlag = false;
     bool dumpFlag = false;
+    bool fsckFlag = false;
 	// MP4 mod tag
 	char *createDirectoryName = NULL;
 	char *listDirectoryName = NULL;
@@ -222,6 +321,9 @@ main(int argc, char **argv)
 	else if (strcmp(argv[i], "-N") == 0) {
 	    networkTestFlag = TRUE;
 	}
+	else if (strcmp(argv[i], "-B") == 0) {
+	    benchmarkFlag = TRUE;
+	}
 #ifndef FILESYS_STUB
 	else if (strcmp(argv[i], "-cp") == 0) {
 	    ASSERT(i + 2 < argc);
@@ -229,6 +331,12 @@ main(int argc, char **argv)
 	    copyNachosFileName = argv[i + 2];
 	    i += 2;
 	}
+	else if (strcmp(argv[i], "-cpout") == 0) {
+	    ASSERT(i + 2 < argc);
+	    copyOutNachosFileName = argv[i + 1];
+	    copyOutUnixFileName = argv[i + 2];
+	    i += 2;
+	}
 	else if (strcmp(argv[i], "-p") == 0) {
 	    ASSERT(i + 1 < argc);
 	    printFileName = argv[i + 1];
@@ -272,15 +380,21 @@ main(int argc, char **argv)
 	else if (strcmp(argv[i], "-D") == 0) {
 	    dumpFlag = true;
 	}
+	else if (strcmp(argv[i], "-fsck") == 0) {
+	    fsckFlag = true;
+	}
 #endif //FILESYS_STUB
 	else if (strcmp(argv[i], "-u") == 0) {
             cout << "Partial usage: nachos [-z -d debugFlags]\n";
             cout << "Partial usage: nachos [-x programName]\n";
-	    cout << "Partial usage: nachos [-K] [-C] [-N]\n";
+	    cout << "Partial usage: nachos [-K] [-C] [-N] [-B]\n";
 #ifndef FILESYS_STUB
             cout << "Partial usage: nachos [-cp UnixFile NachosFile]\n";
+            cout << "Partial usage: nachos [-cpout NachosFile UnixFile]\n";
             cout << "Partial usage: nachos [-p fileName] [-r fileName]\n";
-            cout << "Partial usage: nachos [-l] [-D]\n";
+            cout << "Partial usage: nachos [-l dirName] [-lr dirName] [-D]\n";
+            cout << "Partial usage: nachos [-mkdir dirName] [-rr name]\n";
+            cout << "Partial usage: nachos [-fsck]\n";
 #endif //FILESYS_STUB
 	}
 
@@ -291,6 +405,19 @@ main(int argc, char **argv)
 
     kernel = new Kernel(argc, argv);
 
+#ifndef FILESYS_STUB
+    if (fsckFlag) {			// check the disk before booting on it
+	char diskName[32];
+
+	sprintf(diskName, "DISK_%d", kernel->hostName);
+	DiskChecker *checker = new DiskChecker(diskName);
+	bool ok = checker->Check();
+
+	delete checker;
+	return ok ? 0 : 1;
+    }
+#endif // FILESYS_STUB
+
     kernel->Initialize();
 
     CallOnUserAbort(Cleanup);		// if user hits ctl-C
@@ -306,19 +433,27 @@ main(int argc, char **argv)
     if (networkTestFlag) {
       kernel->NetworkTest();   // two-machine test of the network
     }
+    if (benchmarkFlag) {
+      LibBenchmark();   // time the library routines
+    }
 
 #ifndef FILESYS_STUB
     if (removeFileName != NULL) {
-		kernel->fileSystem->Remove(removeFileName);
+		kernel->fileSystem->Remove(removeFileName, recursiveRemoveFlag);
     }
     if (copyUnixFileName != NULL && copyNachosFileName != NULL) {
-		Copy(copyUnixFileName,copyNachosFileName);
+		if (!Copy(copyUnixFileName,copyNachosFileName))
+			kernel->exitStatus = 1;
+    }
+    if (copyOutNachosFileName != NULL && copyOutUnixFileName != NULL) {
+		CopyOut(copyOutNachosFileName, copyOutUnixFileName);
     }
     if (dumpFlag) {
 		kernel->fileSystem->Print();
     }
     if (dirListFlag) {
-		kernel->fileSystem->List();
+		if (!kernel->fileSystem->List(listDirectoryName, recursiveListFlag))
+			printf("List: no directory %s\n", listDirectoryName);
     }
 	if (mkdirFlag) {
 		// MP4 mod tag
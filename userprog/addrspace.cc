@@ -20,6 +20,7 @@
 #include "addrspace.h"
 #include "machine.h"
 #include "noff.h"
+#include "fdtable.h"
 
 //----------------------------------------------------------------------
 // SwapHeader
@@ -79,6 +80,8 @@ AddrSpace::AddrSpace()
     
     // zero out the entire address space
     bzero(kernel->machine->mainMemory, MemorySize);
+
+    openFiles = new FileDescriptorTable(kernel->openFileTable);
 }
 
 //----------------------------------------------------------------------
@@ -89,6 +92,7 @@ AddrSpace::AddrSpace()
 AddrSpace::~AddrSpace()
 {
    delete pageTable;
+   delete openFiles;
 }
 
 
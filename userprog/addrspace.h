@@ -18,6 +18,8 @@
 
 #define UserStackSize		1024 	// increase this as necessary!
 
+class FileDescriptorTable;
+
 class AddrSpace {
   public:
     AddrSpace();			// Create an address space.
@@ -39,11 +41,15 @@ class AddrSpace {
     // is 0 for Read, 1 for Write.
     ExceptionType Translate(unsigned int vaddr, unsigned int *paddr, int mode);
 
+    FileDescriptorTable *OpenFiles() { return openFiles; }
+					// The files the program has open
+
   private:
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    FileDescriptorTable *openFiles;	// The program's file descriptors
 
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code
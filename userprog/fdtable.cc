@@ -0,0 +1,288 @@
+// fdtable.cc
+//	Routines to manage the system-wide table of open files, and the
+//	file descriptors of each address space.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "debug.h"
+#include "fdtable.h"
+#include "syscall.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// OpenFileTable::OpenFileTable
+// 	Initialize an empty system-wide table of open files.
+//----------------------------------------------------------------------
+
+OpenFileTable::OpenFileTable()
+{
+    table = new OpenFileEntry *[MaxSystemOpenFiles];
+    for (int i = 0; i < MaxSystemOpenFiles; i++)
+	table[i] = NULL;
+    inUse = new Bitmap(MaxSystemOpenFiles);
+    lock = new Lock("open file table lock");
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::~OpenFileTable
+// 	De-allocate the table.  Nachos is halting, so any file a program
+//	left open is never going to be closed; close it now, while the
+//	file system can still write back its header.
+//----------------------------------------------------------------------
+
+OpenFileTable::~OpenFileTable()
+{
+    for (int i = 0; i < MaxSystemOpenFiles; i++)
+	if (table[i] != NULL) {
+	    delete table[i]->file;
+	    delete table[i];
+	}
+    delete [] table;
+    delete inUse;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Add
+// 	Make an entry for a file a program has just opened, referred to
+//	by one descriptor.  Return NULL if the table is full.
+//
+//	"file" -- the open file
+//----------------------------------------------------------------------
+
+OpenFileEntry *
+OpenFileTable::Add(OpenFile *file)
+{
+    OpenFileEntry *entry;
+    int slot;
+
+    lock->Acquire();
+    slot = inUse->FindAndSet();
+    if (slot < 0) {
+	lock->Release();
+	return NULL;
+    }
+    entry = new OpenFileEntry;
+    entry->file = file;
+    entry->refCount = 1;
+    entry->slot = slot;
+    table[slot] = entry;
+    lock->Release();
+    DEBUG(dbgFile, "Open file table: entry " << slot);
+    return entry;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Share
+// 	Count one more descriptor referring to an entry.
+//
+//	"entry" -- the entry, as returned by Add
+//----------------------------------------------------------------------
+
+void
+OpenFileTable::Share(OpenFileEntry *entry)
+{
+    lock->Acquire();
+    ASSERT(entry->refCount > 0);
+    entry->refCount++;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Release
+// 	Count one less descriptor referring to an entry.  When the last
+//	one is closed, close the file and free the entry.
+//
+//	"entry" -- the entry, as returned by Add
+//----------------------------------------------------------------------
+
+void
+OpenFileTable::Release(OpenFileEntry *entry)
+{
+    lock->Acquire();
+    ASSERT(entry->refCount > 0 && table[entry->slot] == entry);
+    if (--entry->refCount > 0) {
+	lock->Release();
+	return;
+    }
+    table[entry->slot] = NULL;
+    inUse->Clear(entry->slot);
+    lock->Release();
+    DEBUG(dbgFile, "Open file table: closing entry " << entry->slot);
+    delete entry->file;			// may wait for the disk
+    delete entry;
+}
+
+#ifndef FILESYS_STUB
+//----------------------------------------------------------------------
+// OpenFileTable::SelfTest
+// 	Give the descriptor tables of two address spaces descriptors
+//	referring to the same entry, and check that they share the
+//	position in the file, and that the file stays open until both
+//	descriptors are closed.
+//----------------------------------------------------------------------
+
+void
+OpenFileTable::SelfTest()
+{
+    char *name = "/fdtest";
+    char buf[4];
+    OpenFileTable *system = new OpenFileTable();
+    FileDescriptorTable *first = new FileDescriptorTable(system);
+    FileDescriptorTable *second = new FileDescriptorTable(system);
+    int fd, shared;
+
+    DEBUG(dbgFile, "Entering OpenFileTable::SelfTest");
+    ASSERT(kernel->fileSystem->Create(name, 0));
+    fd = first->Open(kernel->fileSystem->Open(name));
+    ASSERT(fd >= 0);
+    ASSERT(first->Lookup(fd)->Write("0123456789", 10) == 10);
+    first->Lookup(fd)->Seek(0);
+
+    shared = first->Duplicate(fd, second);
+    ASSERT(shared >= 0 && second->Lookup(shared) == first->Lookup(fd));
+    ASSERT(system->inUse->NumClear() == MaxSystemOpenFiles - 1);
+    ASSERT(first->Lookup(fd)->Read(buf, 4) == 4 && buf[0] == '0');
+    ASSERT(second->Lookup(shared)->Read(buf, 4) == 4 && buf[0] == '4');
+
+    ASSERT(first->Close(fd) && first->Lookup(fd) == NULL);
+    ASSERT(second->Lookup(shared)->Read(buf, 4) == 2 && buf[0] == '8');
+    ASSERT(second->Close(shared));
+    ASSERT(system->inUse->NumClear() == MaxSystemOpenFiles);
+
+    delete second;
+    delete first;
+    delete system;
+    ASSERT(kernel->fileSystem->Remove(name));
+}
+#endif // FILESYS_STUB
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::FileDescriptorTable
+// 	Initialize the descriptors of a new address space.  Only the
+//	console's are taken.
+//
+//	"system" -- the system-wide table of open files
+//----------------------------------------------------------------------
+
+FileDescriptorTable::FileDescriptorTable(OpenFileTable *system)
+{
+    this->system = system;
+    for (int i = 0; i < MaxOpenFiles; i++)
+	entries[i] = NULL;
+    inUse = new Bitmap(MaxOpenFiles);
+    inUse->Mark(SysConsoleInput);
+    inUse->Mark(SysConsoleOutput);
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::~FileDescriptorTable
+// 	De-allocate the descriptors, closing any still open.
+//----------------------------------------------------------------------
+
+FileDescriptorTable::~FileDescriptorTable()
+{
+    for (int i = 0; i < MaxOpenFiles; i++)
+	if (entries[i] != NULL)
+	    system->Release(entries[i]);
+    delete inUse;
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::Open
+// 	Give a file the program has just opened the lowest free
+//	descriptor, and a new entry in the system-wide table.  Return
+//	-1 if either table is full; the file is closed.
+//
+//	"file" -- the open file
+//----------------------------------------------------------------------
+
+int
+FileDescriptorTable::Open(OpenFile *file)
+{
+    OpenFileEntry *entry;
+    int fd = inUse->FindAndSet();
+
+    if (fd < 0) {
+	delete file;
+	return -1;
+    }
+    entry = system->Add(file);
+    if (entry == NULL) {
+	inUse->Clear(fd);
+	delete file;
+	return -1;
+    }
+    entries[fd] = entry;
+    return fd;
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::Duplicate
+// 	Make a new descriptor in "into" referring to the same entry as
+//	"fd", and so sharing its position.  "into" may be this table, as
+//	for UNIX dup, or that of another address space, which then shares
+//	the open file the way a UNIX child shares its parent's.  Return
+//	the new descriptor, or -1 if "fd" is not open or "into" has no
+//	descriptor free.
+//
+//	"fd" -- the descriptor to duplicate
+//	"into" -- the table to give the new descriptor
+//----------------------------------------------------------------------
+
+int
+FileDescriptorTable::Duplicate(int fd, FileDescriptorTable *into)
+{
+    int newFd;
+
+    if (Lookup(fd) == NULL)
+	return -1;
+    newFd = into->inUse->FindAndSet();
+    if (newFd < 0)
+	return -1;
+    system->Share(entries[fd]);
+    into->entries[newFd] = entries[fd];
+    return newFd;
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::Lookup
+// 	Return the open file a descriptor refers to, or NULL if the
+//	descriptor is not open (or is the console's).
+//
+//	"fd" -- the descriptor, as given by the user program
+//----------------------------------------------------------------------
+
+OpenFile *
+FileDescriptorTable::Lookup(int fd)
+{
+    if (fd < 0 || fd >= MaxOpenFiles || entries[fd] == NULL)
+	return NULL;
+    return entries[fd]->file;
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::Close
+// 	Close a descriptor.  The file itself is closed once no other
+//	descriptor refers to it.  Return FALSE if the descriptor was not
+//	open.
+//
+//	"fd" -- the descriptor, as given by the user program
+//----------------------------------------------------------------------
+
+bool
+FileDescriptorTable::Close(int fd)
+{
+    OpenFileEntry *entry;
+
+    if (Lookup(fd) == NULL)
+	return FALSE;
+    entry = entries[fd];
+    entries[fd] = NULL;
+    inUse->Clear(fd);
+    system->Release(entry);
+    return TRUE;
+}
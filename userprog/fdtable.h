@@ -0,0 +1,100 @@
+// fdtable.h
+//	Data structures for the files opened by user programs.
+//
+//	As in UNIX, there are two levels of tables.  The kernel keeps a
+//	single, system-wide table of open files; an entry is made each
+//	time a program opens a file, and holds the OpenFile, and so the
+//	current position in the file.  Each address space has its own
+//	table of file descriptors -- the OpenFileIds handed to the user
+//	program -- each of which refers to an entry in the system-wide
+//	table.  Several descriptors, in one address space or several, may
+//	refer to the same entry, sharing its position; the entry is
+//	reference counted, and the file is closed when the last
+//	descriptor referring to it is closed.
+//
+//	Descriptors 0 and 1 are reserved for the console (cf. syscall.h),
+//	so the first file a program opens is given descriptor 2.
+//
+//	Looking up a descriptor is just indexing the program's own table,
+//	so Read and Write never wait for another program.  Only opening
+//	and closing files touches the system-wide table, under its lock.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FDTABLE_H
+#define FDTABLE_H
+
+#include "copyright.h"
+#include "bitmap.h"
+#include "synch.h"
+#include "filesys.h"
+
+const int MaxOpenFiles = 20;		// descriptors per address space,
+					// including the console's
+const int MaxSystemOpenFiles = 256;	// entries in the system-wide table
+
+// The following class defines an entry in the system-wide table of
+// open files.
+//
+// Internal data structures kept public so that the descriptor tables
+// can access them directly.
+
+class OpenFileEntry {
+  public:
+    OpenFile *file;			// The open file, with its position
+    int refCount;			// Descriptors referring to it
+    int slot;				// Where it is in the system table
+};
+
+// The following class defines the system-wide table of open files.
+
+class OpenFileTable {
+  public:
+    OpenFileTable();			// Initialize an empty table
+    ~OpenFileTable();			// Close every file still open
+
+    OpenFileEntry *Add(OpenFile *file);	// Make an entry for a file just
+					// opened; NULL if the table is full
+    void Share(OpenFileEntry *entry);	// One more descriptor refers to
+					// the entry
+    void Release(OpenFileEntry *entry);	// One less; the last closes the
+					// file
+
+    static void SelfTest();		// Test sharing an entry
+
+  private:
+    OpenFileEntry **table;		// The entries, by slot
+    Bitmap *inUse;			// Which slots hold an entry
+    Lock *lock;				// Only one thread may change the
+					// table at a time
+};
+
+// The following class defines the file descriptors of an address space.
+
+class FileDescriptorTable {
+  public:
+    FileDescriptorTable(OpenFileTable *system);
+					// Initialize an empty table, whose
+					// entries go in "system"
+    ~FileDescriptorTable();		// Close every descriptor still open
+
+    int Open(OpenFile *file);		// Give a file just opened a
+					// descriptor; -1 if none is free,
+					// in which case the file is closed
+    int Duplicate(int fd, FileDescriptorTable *into);
+					// Make a descriptor in "into"
+					// sharing the entry of "fd"; -1
+					// on error
+    OpenFile *Lookup(int fd);		// The file "fd" refers to, or NULL
+    bool Close(int fd);			// Close a descriptor
+
+  private:
+    OpenFileTable *system;		// The system-wide table
+    OpenFileEntry *entries[MaxOpenFiles];
+					// Descriptor -> system table entry
+    Bitmap *inUse;			// Which descriptors are taken
+};
+
+#endif // FDTABLE_H